@@ -0,0 +1,47 @@
+#include <cstdlib>
+#include <new>
+
+#include "allocations.h"
+
+// Replaces the global operator new and delete to count allocations for the phase of the allocating thread.
+// Every block starts with a header holding its size and the phase it was counted for, as delete is not always told
+// the size; the header keeps the default alignment of new.
+
+struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) AllocationHeader {
+    AllocationCounters *phase;
+    size_t size;
+};
+
+void *operator new(size_t size) {
+    auto header = static_cast<AllocationHeader *>(std::malloc(sizeof(AllocationHeader) + size));
+    if (!header) {
+        throw std::bad_alloc();
+    }
+
+    header->phase = current_allocation_phase();
+    header->size = size;
+
+    if (header->phase) {
+        header->phase->allocated(size);
+    }
+
+    return header + 1;
+}
+
+void operator delete(void *pointer) noexcept {
+    if (!pointer) {
+        return;
+    }
+
+    auto header = static_cast<AllocationHeader *>(pointer) - 1;
+
+    if (header->phase) {
+        header->phase->freed(header->size);
+    }
+
+    std::free(header);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    operator delete(pointer);
+}
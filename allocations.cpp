@@ -0,0 +1,83 @@
+#include "allocations.h"
+
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+
+// Phases are registered without allocating, so registering one from within operator new cannot recurse
+static const size_t s_max_phases = 32;
+
+static AllocationCounters s_phases[s_max_phases];
+static size_t s_phase_count{0};
+static std::mutex s_phases_mutex;
+static std::atomic<bool> s_enabled{false};
+static thread_local AllocationCounters *s_current{nullptr};
+
+void AllocationCounters::allocated(size_t size) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+
+    size_t now = live.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t highest = peak.load(std::memory_order_relaxed);
+
+    while (now > highest && !peak.compare_exchange_weak(highest, now, std::memory_order_relaxed)) { }
+}
+
+void AllocationCounters::freed(size_t size) {
+    live.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void enable_allocation_tracking() {
+    s_enabled = true;
+}
+
+bool allocation_tracking_enabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+AllocationCounters *current_allocation_phase() {
+    return s_current;
+}
+
+static AllocationCounters *find_phase(const char *name) {
+    std::lock_guard lock(s_phases_mutex);
+
+    for (size_t i = 0; i < s_phase_count; i++) {
+        if (std::strcmp(s_phases[i].name, name) == 0) {
+            return &s_phases[i];
+        }
+    }
+
+    // Further phases are counted with the last one
+    if (s_phase_count == s_max_phases) {
+        return &s_phases[s_max_phases - 1];
+    }
+
+    s_phases[s_phase_count].name = name;
+    return &s_phases[s_phase_count++];
+}
+
+AllocationPhase::AllocationPhase(const char *name)
+    : m_previous(s_current)
+{
+    if (allocation_tracking_enabled()) {
+        s_current = find_phase(name);
+    }
+}
+
+AllocationPhase::~AllocationPhase() {
+    s_current = m_previous;
+}
+
+void report_allocations(std::ostream &stream) {
+    std::lock_guard lock(s_phases_mutex);
+
+    stream << std::left << std::setw(16) << "phase" << std::right << std::setw(14) << "allocations"
+           << std::setw(16) << "bytes" << std::setw(16) << "peak live" << std::endl;
+
+    for (size_t i = 0; i < s_phase_count; i++) {
+        const auto &phase = s_phases[i];
+        stream << std::left << std::setw(16) << phase.name << std::right << std::setw(14) << phase.count.load()
+               << std::setw(16) << phase.bytes.load() << std::setw(16) << phase.peak.load() << std::endl;
+    }
+}
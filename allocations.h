@@ -0,0 +1,46 @@
+#ifndef MIMA_COMPILER_ALLOCATIONS_H
+#define MIMA_COMPILER_ALLOCATIONS_H
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+
+// Allocations of one phase of the compiler over all compilations and threads. Live bytes go down again when memory
+// allocated in the phase is freed, whichever phase frees it.
+struct AllocationCounters {
+    const char *name{nullptr};
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> live{0};
+    std::atomic<size_t> peak{0};
+
+    void allocated(size_t size);
+    void freed(size_t size);
+};
+
+// Tracking is opt-in: phases are only recorded once it is enabled, and only executables linking
+// allocation_tracker.cpp, which replaces operator new and delete, count anything. They only do so when configured
+// with MIMA_ALLOCATION_TRACKING, as the replacement costs every allocation a header even while tracking is off.
+void enable_allocation_tracking();
+bool allocation_tracking_enabled();
+
+// Phase the allocations of the current thread are counted for, nullptr outside of phases or without tracking
+AllocationCounters *current_allocation_phase();
+
+// Counts the allocations of the current thread for a phase while it exists, phases nest
+class AllocationPhase {
+public:
+    explicit AllocationPhase(const char *name);
+    ~AllocationPhase();
+
+    AllocationPhase(const AllocationPhase &) = delete;
+    AllocationPhase &operator=(const AllocationPhase &) = delete;
+
+private:
+    AllocationCounters *m_previous;
+};
+
+// One line per phase in the order they were first entered
+void report_allocations(std::ostream &stream);
+
+#endif //MIMA_COMPILER_ALLOCATIONS_H
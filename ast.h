@@ -2,33 +2,25 @@
 #define MIMA_COMPILER_AST_H
 
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 #include "forward.h"
 
-class NodeVisitor {
-public:
-    virtual void visit_var_statement(VarStatement *node, int visit_count) = 0;
-    virtual void visit_assignment_statement(AssignmentStatement *node, int visit_count) = 0;
-    virtual void visit_origin_statement(OriginStatement *node, int visit_count) = 0;
-    virtual void visit_conditional_statement(ConditionalStatement *node, int visit_count) = 0;
-    virtual void visit_while_statement(WhileStatement *node, int visit_count) = 0;
-    virtual void visit_epsilon_statement(EpsilonStatement *node, int visit_count) = 0;
-    virtual void visit_number_expression_1(NumberExpression1 *node, int visit_count) = 0;
-    virtual void visit_number_expression_2(NumberExpression2 *node, int visit_count) = 0;
-    virtual void visit_number_expression_3(NumberExpression3 *node, int visit_count) = 0;
-    virtual void visit_number_expression_4(NumberExpression4 *node, int visit_count) = 0;
-    virtual void visit_number_expression_5(NumberExpression5 *node, int visit_count) = 0;
-    virtual void visit_boolean_expression_1(BooleanExpression1 *node, int visit_count) = 0;
-    virtual void visit_boolean_expression_2(BooleanExpression2 *node, int visit_count) = 0;
-    virtual void visit_boolean_expression_3(BooleanExpression3 *node, int visit_count) = 0;
-    virtual void visit_boolean_expression_4(BooleanExpression4 *node, int visit_count) = 0;
-    virtual void visit_variable_expression(VariableExpression *node, int visit_count) = 0;
-    virtual void visit_value_expression(ValueExpression *node, int visit_count) = 0;
-    virtual void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) = 0;
-};
-
-enum Comparison {
+// Operators of binary expressions, number and boolean expressions share the node
+enum BinaryOperator {
+    BitwiseAnd,
+    ShiftRight,
+    Addition,
+    Subtraction,
+    Multiplication,
+    Division,
+    Modulo,
+    LogicalOr,
+    LogicalAnd,
     Equals,
     NotEquals,
     LessThan,
@@ -37,26 +29,72 @@ enum Comparison {
     GreaterThanOrEqual,
 };
 
+enum UnaryOperator {
+    Negation,
+    LogicalNot,
+};
+
+enum class NodeKind {
+    VarStatement,
+    AssignmentStatement,
+    OriginStatement,
+    ConditionalStatement,
+    WhileStatement,
+    SwitchStatement,
+    EpsilonStatement,
+    BinaryExpression,
+    UnaryExpression,
+    IndexExpression,
+    VariableExpression,
+    ValueExpression,
+    BooleanValueExpression,
+};
+
+// Nodes carry their kind instead of a vtable, the traversal dispatches on it with a switch
 class Node {
 public:
-    virtual void visit(NodeVisitor &visitor) = 0;
+    [[nodiscard]] NodeKind get_kind() const { return m_kind; }
+
+protected:
+    explicit Node(NodeKind kind)
+        : m_kind(kind)
+    { }
+
+private:
+    NodeKind m_kind;
 };
 
+// Returns the node as T if it has T's kind, nullptr otherwise
+template <typename T>
+T *node_cast(Node *node) {
+    return node && node->get_kind() == T::s_kind ? static_cast<T *>(node) : nullptr;
+}
+
 class Statement : public Node {
 public:
     void set_next(std::shared_ptr<Statement> statement) { m_next = std::move(statement); }
-    [[nodiscard]] std::shared_ptr<Statement> get_next() const { return m_next; }
+    [[nodiscard]] const std::shared_ptr<Statement> &get_next() const { return m_next; }
+
+    // First token of the statement in the source, empty for statements the parser made up
+    void set_location(std::string_view location) { m_location = location; }
+    [[nodiscard]] std::string_view get_location() const { return m_location; }
 
 protected:
+    explicit Statement(NodeKind kind)
+        : Node(kind)
+    { }
+
     std::shared_ptr<Statement> m_next{nullptr};
+    std::string_view m_location{};
 };
 
 class VarStatement : public Statement {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_var_statement(this, 0);
-        m_next->visit(visitor);
-    };
+    static constexpr NodeKind s_kind = NodeKind::VarStatement;
+
+    VarStatement()
+        : Statement(s_kind)
+    { }
 
     void set_identifier(std::string_view identifier) { m_identifier = identifier; }
     [[nodiscard]] std::string_view get_identifier() const { return m_identifier; }
@@ -67,38 +105,49 @@ public:
     void set_number(int number) { m_number = number; }
     [[nodiscard]] int get_number() const { return m_number; }
 
+    // Arrays have a size of at least one and no initial value
+    void set_array_size(int array_size) { m_array_size = array_size; }
+    [[nodiscard]] int get_array_size() const { return m_array_size; }
+    [[nodiscard]] bool is_array() const { return m_array_size > 0; }
+
 private:
     std::string_view m_identifier{};
     bool m_has_initial_value{};
     int m_number{};
+    int m_array_size{0};
 };
 
 class AssignmentStatement : public Statement {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_assignment_statement(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_assignment_statement(this, 1);
-        m_next->visit(visitor);
-    };
+    static constexpr NodeKind s_kind = NodeKind::AssignmentStatement;
+
+    AssignmentStatement()
+        : Statement(s_kind)
+    { }
 
     void set_identifier(std::string_view identifier) { m_identifier = identifier; }
     [[nodiscard]] std::string_view get_identifier() const { return m_identifier; }
 
     void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_expression() const { return m_expression; }
+
+    // An assignment to an array element stores through the element, which is visited after the expression
+    void set_element(std::shared_ptr<IndexExpression> element) { m_element = std::move(element); }
+    [[nodiscard]] const std::shared_ptr<IndexExpression> &get_element() const { return m_element; }
 
 private:
     std::string_view m_identifier{};
     std::shared_ptr<Node> m_expression{nullptr};
+    std::shared_ptr<IndexExpression> m_element{nullptr};
 };
 
 class OriginStatement : public Statement {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_origin_statement(this, 0);
-        m_next->visit(visitor);
-    };
+    static constexpr NodeKind s_kind = NodeKind::OriginStatement;
+
+    OriginStatement()
+        : Statement(s_kind)
+    { }
 
     void set_number(int number) { m_number = number; }
     [[nodiscard]] int get_number() const { return m_number; }
@@ -109,288 +158,208 @@ private:
 
 class ConditionalStatement : public Statement {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_conditional_statement(this, 0);
-        m_bool_expression->visit(visitor);
-        visitor.visit_conditional_statement(this, 1);
-        m_inner->visit(visitor);
-        visitor.visit_conditional_statement(this, 2);
-        if (m_else) {
-            m_else->visit(visitor);
-            visitor.visit_conditional_statement(this, 3);
-        }
-        m_next->visit(visitor);
-    };
+    static constexpr NodeKind s_kind = NodeKind::ConditionalStatement;
+
+    ConditionalStatement()
+        : Statement(s_kind)
+    { }
 
     void set_bool_expression(std::shared_ptr<Node> expression) { m_bool_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_bool_expression() const { return m_bool_expression; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_bool_expression() const { return m_bool_expression; }
 
     void set_inner(std::shared_ptr<Node> expression) { m_inner = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_inner() const { return m_inner; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_inner() const { return m_inner; }
 
     void set_else(std::shared_ptr<Node> expression) { m_else = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_else() const { return m_else; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_else() const { return m_else; }
+
+    // An else-if is the else branch of another conditional, which owns the following statement
+    void set_else_if(bool else_if) { m_else_if = else_if; }
+    [[nodiscard]] bool is_else_if() const { return m_else_if; }
 
 private:
     std::shared_ptr<Node> m_bool_expression;
     std::shared_ptr<Node> m_inner;
     std::shared_ptr<Node> m_else;
+    bool m_else_if{false};
 };
 
 class WhileStatement : public Statement {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_while_statement(this, 0);
-        m_bool_expression->visit(visitor);
-        visitor.visit_while_statement(this, 1);
-        m_inner->visit(visitor);
-        visitor.visit_while_statement(this, 2);
-        m_next->visit(visitor);
-    };
+    static constexpr NodeKind s_kind = NodeKind::WhileStatement;
+
+    WhileStatement()
+        : Statement(s_kind)
+    { }
 
     void set_bool_expression(std::shared_ptr<Node> expression) { m_bool_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_bool_expression() const { return m_bool_expression; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_bool_expression() const { return m_bool_expression; }
 
     void set_inner(std::shared_ptr<Node> expression) { m_inner = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_inner() const { return m_inner; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_inner() const { return m_inner; }
 
 private:
     std::shared_ptr<Node> m_bool_expression;
     std::shared_ptr<Node> m_inner;
 };
 
-class EpsilonStatement : public Statement {
-public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_epsilon_statement(this, 0);
-    };
+// One case of a switch statement, its body runs up to the next case without falling through
+struct SwitchCase {
+    int value{};
+    bool is_default{false};
+    // The value as written, for errors
+    std::string_view label{};
+    std::shared_ptr<Statement> body{nullptr};
 };
 
-class NumberExpression1 : public Node {
+class SwitchStatement : public Statement {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_number_expression_1(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_number_expression_1(this, 1);
-        if (m_bitwise_and) {
-            m_bitwise_and->visit(visitor);
-        }
-        visitor.visit_number_expression_1(this, 2);
-    };
-
-    void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
-
-    void set_bitwise_and(std::shared_ptr<Node> bitwise_and) { m_bitwise_and = std::move(bitwise_and); }
-    [[nodiscard]] std::shared_ptr<Node> get_bitwise_and() const { return m_bitwise_and; }
-
-private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    std::shared_ptr<Node> m_bitwise_and{nullptr};
-};
+    static constexpr NodeKind s_kind = NodeKind::SwitchStatement;
 
-class NumberExpression2 : public Node {
-public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_number_expression_2(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_number_expression_2(this, 1);
-        if (m_bitshift) {
-            m_bitshift->visit(visitor);
-        }
-        visitor.visit_number_expression_2(this, 2);
-    };
+    SwitchStatement()
+        : Statement(s_kind)
+    { }
 
     void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
-
-    void set_bitshift(std::shared_ptr<Node> bitshift) { m_bitshift = std::move(bitshift); }
-    [[nodiscard]] std::shared_ptr<Node> get_bitshift() const { return m_bitshift; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_expression() const { return m_expression; }
 
-    void set_left(bool left) { m_left = left; }
-    [[nodiscard]] bool is_left() const { return m_left; }
+    // Cases in the order they are written, the default case may be any of them
+    void add_case(SwitchCase switch_case) { m_default |= switch_case.is_default; m_cases.push_back(std::move(switch_case)); }
+    [[nodiscard]] const std::vector<SwitchCase> &get_cases() const { return m_cases; }
+    [[nodiscard]] bool has_default() const { return m_default; }
 
 private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    std::shared_ptr<Node> m_bitshift{nullptr};
-    bool m_left{false};
+    std::shared_ptr<Node> m_expression;
+    std::vector<SwitchCase> m_cases{};
+    bool m_default{false};
 };
 
-class NumberExpression3 : public Node {
+class EpsilonStatement : public Statement {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_number_expression_3(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_number_expression_3(this, 1);
-        if (m_addition) {
-            m_addition->visit(visitor);
-        }
-        visitor.visit_number_expression_3(this, 2);
-    };
+    static constexpr NodeKind s_kind = NodeKind::EpsilonStatement;
 
-    void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
-
-    void set_addition(std::shared_ptr<Node> addition) { m_addition = std::move(addition); }
-    [[nodiscard]] std::shared_ptr<Node> get_addition() const { return m_addition; }
-
-private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    std::shared_ptr<Node> m_addition{nullptr};
+    EpsilonStatement()
+        : Statement(s_kind)
+    { }
 };
 
-class NumberExpression4 : public Node {
+class BinaryExpression : public Node {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_number_expression_4(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_number_expression_4(this, 1);
-    };
+    static constexpr NodeKind s_kind = NodeKind::BinaryExpression;
 
-    void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
+    BinaryExpression()
+        : Node(s_kind)
+    { }
 
-    void set_negated(bool negated) { m_negated = negated; }
-    [[nodiscard]] bool is_negated() const { return m_negated; }
+    void set_operator(BinaryOperator op) { m_operator = op; }
+    [[nodiscard]] BinaryOperator get_operator() const { return m_operator; }
 
-private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    bool m_negated{};
-};
+    void set_left(std::shared_ptr<Node> left) { m_left = std::move(left); }
+    [[nodiscard]] const std::shared_ptr<Node> &get_left() const { return m_left; }
 
-class NumberExpression5 : public Node {
-public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_number_expression_5(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_number_expression_5(this, 1);
-    };
+    void set_right(std::shared_ptr<Node> right) { m_right = std::move(right); }
+    [[nodiscard]] const std::shared_ptr<Node> &get_right() const { return m_right; }
 
-    void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
+    // A constant operand of * / % is folded into the node by the generator, replacing the right node
+    void set_constant(int constant) { m_constant = constant; m_has_constant = true; }
+    [[nodiscard]] int get_constant() const { return m_constant; }
+    [[nodiscard]] bool has_constant() const { return m_has_constant; }
 
-    void set_nested(bool is_nested) { m_is_nested = true; }
-    [[nodiscard]] bool is_nested() const { return m_is_nested; }
+    // A variable or constant right operand is folded into the node by the generator and addressed directly
+    void set_direct_operand(std::string operand) { m_direct_operand = std::move(operand); }
+    [[nodiscard]] const std::string &get_direct_operand() const { return m_direct_operand; }
 
-private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    bool m_is_nested{false};
-};
+    // Set by the generator on a comparison that is the condition of an if or while, which only needs
+    // AKKU to be negative if the comparison is false instead of a boolean
+    void set_branch_condition(bool branch_condition) { m_branch_condition = branch_condition; }
+    [[nodiscard]] bool is_branch_condition() const { return m_branch_condition; }
 
-class BooleanExpression1 : public Node {
-public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_boolean_expression_1(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_boolean_expression_1(this, 1);
-        if (m_logical_or) {
-            m_logical_or->visit(visitor);
-        }
-        visitor.visit_boolean_expression_1(this, 2);
-    };
+    // Set by the generator on a comparison whose left operand is masked by a constant without the sign bit,
+    // so it lies in [0, mask]
+    void set_left_mask(int mask) { m_left_mask = mask; }
+    [[nodiscard]] std::optional<int> get_left_mask() const { return m_left_mask; }
 
-    void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
-
-    void set_logical_or(std::shared_ptr<Node> other) { m_logical_or = std::move(other); }
-    [[nodiscard]] std::shared_ptr<Node> get_logical_or() const { return m_logical_or; }
+    // Operator token in the source, errors about the operation point at it
+    void set_location(std::string_view location) { m_location = location; }
+    [[nodiscard]] std::string_view get_location() const { return m_location; }
 
 private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    std::shared_ptr<Node> m_logical_or{nullptr};
+    BinaryOperator m_operator{};
+    std::shared_ptr<Node> m_left{nullptr};
+    std::shared_ptr<Node> m_right{nullptr};
+    int m_constant{};
+    bool m_has_constant{false};
+    std::string m_direct_operand{};
+    bool m_branch_condition{false};
+    std::optional<int> m_left_mask{};
+    std::string_view m_location{};
 };
 
-class BooleanExpression2 : public Node {
+class UnaryExpression : public Node {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_boolean_expression_2(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_boolean_expression_2(this, 1);
-        if (m_logical_and) {
-            m_logical_and->visit(visitor);
-        }
-        visitor.visit_boolean_expression_2(this, 2);
-    };
+    static constexpr NodeKind s_kind = NodeKind::UnaryExpression;
 
-    void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
+    UnaryExpression()
+        : Node(s_kind)
+    { }
 
-    void set_logical_and(std::shared_ptr<Node> other) { m_logical_and = std::move(other); }
-    [[nodiscard]] std::shared_ptr<Node> get_logical_and() const { return m_logical_and; }
-
-private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    std::shared_ptr<Node> m_logical_and{nullptr};
-};
-
-class BooleanExpression3 : public Node {
-public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_boolean_expression_3(this, 0);
-        m_expression->visit(visitor);
-        visitor.visit_boolean_expression_3(this, 1);
-    };
+    void set_operator(UnaryOperator op) { m_operator = op; }
+    [[nodiscard]] UnaryOperator get_operator() const { return m_operator; }
 
     void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
-
-    void set_negated(bool negated) { m_negated = true; }
-    [[nodiscard]] bool is_negated() const { return m_negated; }
+    [[nodiscard]] const std::shared_ptr<Node> &get_expression() const { return m_expression; }
 
 private:
+    UnaryOperator m_operator{};
     std::shared_ptr<Node> m_expression{nullptr};
-    bool m_negated{};
 };
 
-class BooleanExpression4 : public Node {
+class IndexExpression : public Node {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_boolean_expression_4(this, 0);
-        if (!m_is_comparison) {
-            m_expression->visit(visitor);
-        } else {
-            m_left->visit(visitor);
-        }
-        visitor.visit_boolean_expression_4(this, 1);
-        if (m_is_comparison) {
-            m_right->visit(visitor);
-            visitor.visit_boolean_expression_4(this, 2);
-        }
+    static constexpr NodeKind s_kind = NodeKind::IndexExpression;
 
-    };
+    IndexExpression()
+        : Node(s_kind)
+    { }
 
-    void set_expression(std::shared_ptr<Node> expression) { m_expression = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_expression() const { return m_expression; }
+    void set_identifier(std::string_view identifier) { m_identifier = identifier; }
+    [[nodiscard]] std::string_view get_identifier() const { return m_identifier; }
 
-    void set_left(std::shared_ptr<Node> expression) { m_left = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_left() const { return m_left; }
+    void set_index(std::shared_ptr<Node> index) { m_index = std::move(index); }
+    [[nodiscard]] const std::shared_ptr<Node> &get_index() const { return m_index; }
 
-    void set_comparison(Comparison comparison) { m_comparison = comparison; }
-    [[nodiscard]] Comparison get_comparison() const { return m_comparison; }
+    // The target of an assignment stores AKKU to the element instead of loading it
+    void set_store(bool store) { m_store = store; }
+    [[nodiscard]] bool is_store() const { return m_store; }
 
-    void set_right(std::shared_ptr<Node> expression) { m_right = std::move(expression); }
-    [[nodiscard]] std::shared_ptr<Node> get_right() const { return m_right; }
+    // A variable index is folded into the node by the generator and added to the array's address directly
+    void set_direct_index(std::string index) { m_direct_index = std::move(index); }
+    [[nodiscard]] const std::string &get_direct_index() const { return m_direct_index; }
 
-    void set_nested(bool is_nested) { m_is_nested = is_nested; }
-    [[nodiscard]] bool is_nested() const { return m_is_nested; }
+    // A constant index is folded into the operand ("a+3") by the generator, the element is then a plain cell
+    void set_element(std::string element) { m_element = std::move(element); }
+    [[nodiscard]] const std::string &get_element() const { return m_element; }
 
-    void set_is_comparison(bool is_comparison) { m_is_comparison = is_comparison; }
-    [[nodiscard]] bool is_comparison() const { return m_is_comparison; }
+    // Set by the generator if a cell walking over the array in a loop already holds the element's address
+    void set_pointer(std::string pointer) { m_pointer = std::move(pointer); }
+    [[nodiscard]] const std::string &get_pointer() const { return m_pointer; }
 
 private:
-    std::shared_ptr<Node> m_expression{nullptr};
-    std::shared_ptr<Node> m_left{nullptr};
-    Comparison m_comparison{};
-    std::shared_ptr<Node> m_right{nullptr};
-    bool m_is_nested{false};
-    bool m_is_comparison{false};
+    std::string_view m_identifier{};
+    std::shared_ptr<Node> m_index{nullptr};
+    bool m_store{false};
+    std::string m_direct_index{};
+    std::string m_element{};
+    std::string m_pointer{};
 };
 
 class VariableExpression : public Node {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_variable_expression(this, 0);
-    };
+    static constexpr NodeKind s_kind = NodeKind::VariableExpression;
+
+    VariableExpression()
+        : Node(s_kind)
+    { }
 
     void set_identifier(std::string_view identifier) { m_identifier = identifier; }
     [[nodiscard]] std::string_view get_identifier() const { return m_identifier; }
@@ -401,9 +370,11 @@ private:
 
 class ValueExpression : public Node {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_value_expression(this, 0);
-    };
+    static constexpr NodeKind s_kind = NodeKind::ValueExpression;
+
+    ValueExpression()
+        : Node(s_kind)
+    { }
 
     void set_number(int number) { m_number = number; }
     [[nodiscard]] int get_number() const { return m_number; }
@@ -414,9 +385,11 @@ private:
 
 class BooleanValueExpression : public Node {
 public:
-    void visit(NodeVisitor &visitor) override {
-        visitor.visit_boolean_value_expression(this, 0);
-    };
+    static constexpr NodeKind s_kind = NodeKind::BooleanValueExpression;
+
+    BooleanValueExpression()
+        : Node(s_kind)
+    { }
 
     void set_value(bool value) { m_value = value; }
     [[nodiscard]] int get_value() const { return m_value; }
@@ -425,4 +398,118 @@ private:
     bool m_value{};
 };
 
+// Statically dispatched traversal, derived visitors implement every visit_* method (made accessible to
+// NodeVisitor<Derived>). A node's method is called with the phase in visit_count before, between and after
+// its children, so the parser can create the children it is about to descend into.
+template <typename Derived>
+class NodeVisitor {
+public:
+    void visit(Node *node);
+
+private:
+    Derived &derived() { return static_cast<Derived &>(*this); }
+};
+
+template <typename Derived>
+void NodeVisitor<Derived>::visit(Node *node) {
+    // The successor of a statement is visited in the loop, so long programs do not grow the stack
+    while (node) {
+        switch (node->get_kind()) {
+            case NodeKind::VarStatement: {
+                auto statement = static_cast<VarStatement *>(node);
+                derived().visit_var_statement(statement, 0);
+                node = statement->get_next().get();
+                break;
+            }
+            case NodeKind::AssignmentStatement: {
+                auto statement = static_cast<AssignmentStatement *>(node);
+                derived().visit_assignment_statement(statement, 0);
+                visit(statement->get_expression().get());
+                visit(statement->get_element().get());
+                derived().visit_assignment_statement(statement, 1);
+                node = statement->get_next().get();
+                break;
+            }
+            case NodeKind::OriginStatement: {
+                auto statement = static_cast<OriginStatement *>(node);
+                derived().visit_origin_statement(statement, 0);
+                node = statement->get_next().get();
+                break;
+            }
+            case NodeKind::ConditionalStatement: {
+                auto statement = static_cast<ConditionalStatement *>(node);
+                derived().visit_conditional_statement(statement, 0);
+                visit(statement->get_bool_expression().get());
+                derived().visit_conditional_statement(statement, 1);
+                visit(statement->get_inner().get());
+                derived().visit_conditional_statement(statement, 2);
+                if (statement->get_else()) {
+                    visit(statement->get_else().get());
+                    derived().visit_conditional_statement(statement, 3);
+                }
+                node = statement->get_next().get();
+                break;
+            }
+            case NodeKind::WhileStatement: {
+                auto statement = static_cast<WhileStatement *>(node);
+                derived().visit_while_statement(statement, 0);
+                visit(statement->get_bool_expression().get());
+                derived().visit_while_statement(statement, 1);
+                visit(statement->get_inner().get());
+                derived().visit_while_statement(statement, 2);
+                node = statement->get_next().get();
+                break;
+            }
+            case NodeKind::SwitchStatement: {
+                auto statement = static_cast<SwitchStatement *>(node);
+                derived().visit_switch_statement(statement, 0);
+                visit(statement->get_expression().get());
+                derived().visit_switch_statement(statement, 1);
+                // The parser adds the next case after the body of the previous one, so the size is read every time
+                for (size_t index = 0; index < statement->get_cases().size(); index++) {
+                    visit(statement->get_cases()[index].body.get());
+                    derived().visit_switch_statement(statement, 2 + (int)index);
+                }
+                node = statement->get_next().get();
+                break;
+            }
+            case NodeKind::EpsilonStatement:
+                derived().visit_epsilon_statement(static_cast<EpsilonStatement *>(node), 0);
+                return;
+            case NodeKind::BinaryExpression: {
+                auto expression = static_cast<BinaryExpression *>(node);
+                derived().visit_binary_expression(expression, 0);
+                visit(expression->get_left().get());
+                derived().visit_binary_expression(expression, 1);
+                visit(expression->get_right().get());
+                derived().visit_binary_expression(expression, 2);
+                return;
+            }
+            case NodeKind::UnaryExpression: {
+                auto expression = static_cast<UnaryExpression *>(node);
+                derived().visit_unary_expression(expression, 0);
+                visit(expression->get_expression().get());
+                derived().visit_unary_expression(expression, 1);
+                return;
+            }
+            case NodeKind::IndexExpression: {
+                auto expression = static_cast<IndexExpression *>(node);
+                derived().visit_index_expression(expression, 0);
+                visit(expression->get_index().get());
+                derived().visit_index_expression(expression, 1);
+                return;
+            }
+            case NodeKind::VariableExpression:
+                derived().visit_variable_expression(static_cast<VariableExpression *>(node), 0);
+                return;
+            case NodeKind::ValueExpression:
+                derived().visit_value_expression(static_cast<ValueExpression *>(node), 0);
+                return;
+            case NodeKind::BooleanValueExpression:
+                derived().visit_boolean_value_expression(static_cast<BooleanValueExpression *>(node), 0);
+                return;
+        }
+    }
+}
+
 #endif //MIMA_COMPILER_AST_H
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef MIMA_COMPILER_BOUNDED_QUEUE_H
+#define MIMA_COMPILER_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Hands items from one thread to another, the producer waits while the queue is full. Closing wakes both sides:
+// push fails from then on and pop returns nothing once the remaining items are taken.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_capacity(capacity)
+    { }
+
+    bool push(T item) {
+        std::unique_lock lock(m_mutex);
+        m_not_full.wait(lock, [&] { return m_closed || m_items.size() < m_capacity; });
+
+        if (m_closed) {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock lock(m_mutex);
+        m_not_empty.wait(lock, [&] { return m_closed || !m_items.empty(); });
+
+        if (m_items.empty()) {
+            return std::nullopt;
+        }
+
+        T item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return item;
+    }
+
+    void close() {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex{};
+    std::condition_variable m_not_full{};
+    std::condition_variable m_not_empty{};
+    std::deque<T> m_items{};
+    size_t m_capacity;
+    bool m_closed{false};
+};
+
+#endif //MIMA_COMPILER_BOUNDED_QUEUE_H
@@ -0,0 +1,214 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+#ifndef MIMA_COMPILER_VERSION
+#define MIMA_COMPILER_VERSION "unknown"
+#endif
+
+static const std::string s_magic = "MIMA-CACHE 1";
+static const std::string s_extension = ".mima-cache";
+
+// FNV-1a only names the entry, hits are verified against the stored key material
+static std::uint64_t hash(std::string_view data) {
+    std::uint64_t hash = 0xcbf29ce484222325;
+
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+struct CacheEntry {
+    std::filesystem::path path;
+    std::filesystem::file_time_type time;
+    std::uintmax_t size;
+};
+
+// Entries of the directory and their total size, removes temporaries of writers that died before renaming
+static std::vector<CacheEntry> scan_entries(const std::filesystem::path &directory, std::uintmax_t &total) {
+    std::vector<CacheEntry> entries;
+    std::error_code error;
+    total = 0;
+
+    auto stale = std::filesystem::file_time_type::clock::now() - std::chrono::minutes(10);
+
+    for (const auto &file : std::filesystem::directory_iterator(directory, error)) {
+        if (file.path().extension() != s_extension) {
+            std::error_code stale_error;
+            if (file.path().filename().string().find(s_extension + ".tmp.") != std::string::npos && file.last_write_time(stale_error) < stale) {
+                std::filesystem::remove(file.path(), stale_error);
+            }
+            continue;
+        }
+
+        std::error_code entry_error;
+        auto size = file.file_size(entry_error);
+        auto time = file.last_write_time(entry_error);
+
+        if (!entry_error) {
+            entries.push_back({file.path(), time, size});
+            total += size;
+        }
+    }
+
+    return entries;
+}
+
+CompileCache::CompileCache(std::filesystem::path directory, std::uintmax_t size_limit)
+    : m_directory(std::move(directory))
+    , m_size_limit(size_limit)
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+
+    scan_entries(m_directory, m_size);
+
+    if (m_size > m_size_limit) {
+        evict();
+    }
+}
+
+std::string CompileCache::key_material(std::string_view source, std::string_view options) {
+    std::string material;
+    material.reserve(source.size() + options.size() + 32);
+    material += MIMA_COMPILER_VERSION;
+    material += '\0';
+    material += options;
+    material += '\0';
+    material += source;
+
+    return material;
+}
+
+std::filesystem::path CompileCache::entry_path(const std::string &key_material) const {
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash(key_material) << s_extension;
+
+    return m_directory / name.str();
+}
+
+std::optional<std::string> CompileCache::load(std::string_view source, std::string_view options) const {
+    std::string material = key_material(source, options);
+    std::filesystem::path path = entry_path(material);
+
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        return std::nullopt;
+    }
+
+    std::string magic;
+    size_t material_size = 0;
+    size_t output_size = 0;
+
+    if (!std::getline(stream, magic) || magic != s_magic || !(stream >> material_size >> output_size) || stream.get() != '\n') {
+        return std::nullopt;
+    }
+
+    if (material_size != material.size()) {
+        return std::nullopt;
+    }
+
+    std::string stored_material(material_size, '\0');
+    std::string output(output_size, '\0');
+
+    if (!stream.read(stored_material.data(), (std::streamsize)material_size) || stored_material != material) {
+        return std::nullopt;
+    }
+
+    if (!stream.read(output.data(), (std::streamsize)output_size)) {
+        return std::nullopt;
+    }
+
+    // Refresh the entry for least recently used eviction
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+    return output;
+}
+
+void CompileCache::store(std::string_view source, std::string_view options, std::string_view output) {
+    std::string material = key_material(source, options);
+    std::filesystem::path path = entry_path(material);
+
+    // Write to a unique temporary first, the rename makes the entry appear atomically
+    std::random_device random;
+    std::filesystem::path temporary = path;
+    temporary += ".tmp." + std::to_string(getpid()) + "." + std::to_string(random());
+
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            return;
+        }
+
+        stream << s_magic << '\n' << material.size() << ' ' << output.size() << '\n';
+        stream.write(material.data(), (std::streamsize)material.size());
+        stream.write(output.data(), (std::streamsize)output.size());
+
+        if (!stream.flush()) {
+            stream.close();
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::uintmax_t size = std::filesystem::file_size(temporary, error);
+    std::uintmax_t replaced = std::filesystem::file_size(path, error);
+    if (error) {
+        replaced = 0;
+    }
+
+    std::filesystem::rename(temporary, path, error);
+
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+
+    bool over_limit;
+    {
+        std::lock_guard lock(m_mutex);
+        m_size = m_size + size - std::min(replaced, m_size + size);
+        over_limit = m_size > m_size_limit;
+    }
+
+    if (over_limit) {
+        evict();
+    }
+}
+
+// Rescans the directory, which also picks up the entries of other processes, and removes the least recently used ones
+void CompileCache::evict() {
+    std::lock_guard lock(m_mutex);
+
+    std::uintmax_t total;
+    auto entries = scan_entries(m_directory, total);
+
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry &a, const CacheEntry &b) { return a.time < b.time; });
+
+    // Concurrent invocations may evict the same entries, failing removals are ignored
+    std::error_code error;
+    for (const auto &entry : entries) {
+        if (total <= m_size_limit) {
+            break;
+        }
+
+        std::filesystem::remove(entry.path, error);
+        total -= entry.size;
+    }
+
+    m_size = total;
+}
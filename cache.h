@@ -0,0 +1,35 @@
+#ifndef MIMA_COMPILER_CACHE_H
+#define MIMA_COMPILER_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// On-disk cache of compiled programs, addressed by the source, compiler version and output affecting options.
+// Entries are written atomically and the least recently used ones are evicted once the size limit is exceeded.
+// The directory is only scanned on construction and when evicting, in between stores keep count of its size.
+class CompileCache {
+public:
+    CompileCache(std::filesystem::path directory, std::uintmax_t size_limit);
+
+    std::optional<std::string> load(std::string_view source, std::string_view options) const;
+    void store(std::string_view source, std::string_view options, std::string_view output);
+
+private:
+    static std::string key_material(std::string_view source, std::string_view options);
+    std::filesystem::path entry_path(const std::string &key_material) const;
+    void evict();
+
+    std::filesystem::path m_directory;
+    std::uintmax_t m_size_limit;
+
+    // Size of the entries as of the last scan plus what was stored since. Other processes sharing the directory
+    // are only noticed by the next scan.
+    std::mutex m_mutex;
+    std::uintmax_t m_size{0};
+};
+
+#endif //MIMA_COMPILER_CACHE_H
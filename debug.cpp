@@ -1,16 +1,17 @@
 #include "debug.h"
 
-#include <iostream>
 #include <iomanip>
 
 void PrinterNodeVisitor::visit_var_statement(VarStatement *node, int visit_count) {
     m_depth++;
-    std::cout << std::setw(m_depth) << " " << "Var " << node->get_identifier();
+    m_stream << std::setw(m_depth) << " " << "Var " << node->get_identifier();
 
-    if (node->has_initial_value()) {
-        std::cout << " = " << node->get_number() << std::endl;
+    if (node->is_array()) {
+        m_stream << "[" << node->get_array_size() << "]" << std::endl;
+    } else if (node->has_initial_value()) {
+        m_stream << " = " << node->get_number() << std::endl;
     } else {
-        std::cout << std::endl;
+        m_stream << std::endl;
     }
     m_depth--;
 }
@@ -18,7 +19,7 @@ void PrinterNodeVisitor::visit_var_statement(VarStatement *node, int visit_count
 void PrinterNodeVisitor::visit_assignment_statement(AssignmentStatement *node, int visit_count) {
     if (visit_count == 0) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Assign " << node->get_identifier() << " = " << std::endl;
+        m_stream << std::setw(m_depth) << " " << "Assign " << node->get_identifier() << " = " << std::endl;
     } else if (visit_count == 1) {
         m_depth--;
     }
@@ -26,14 +27,14 @@ void PrinterNodeVisitor::visit_assignment_statement(AssignmentStatement *node, i
 
 void PrinterNodeVisitor::visit_origin_statement(OriginStatement *node, int visit_count) {
     m_depth++;
-    std::cout << std::setw(m_depth) << " " << "Origin " << node->get_number() << std::endl;
+    m_stream << std::setw(m_depth) << " " << "Origin " << node->get_number() << std::endl;
     m_depth--;
 }
 
 void PrinterNodeVisitor::visit_while_statement(WhileStatement *node, int visit_count) {
     if (visit_count == 0) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "While" << std::endl;
+        m_stream << std::setw(m_depth) << " " << "While" << std::endl;
     } else if (visit_count == 2) {
         m_depth--;
     }
@@ -42,135 +43,114 @@ void PrinterNodeVisitor::visit_while_statement(WhileStatement *node, int visit_c
 void PrinterNodeVisitor::visit_conditional_statement(ConditionalStatement *node, int visit_count) {
     if (visit_count == 0) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Conditional" << std::endl;
+        m_stream << std::setw(m_depth) << " " << "Conditional" << std::endl;
     } else if (visit_count == 3) {
         m_depth--;
     }
 }
 
-void PrinterNodeVisitor::visit_epsilon_statement(EpsilonStatement *node, int visit_count) {
-    m_depth++;
-    std::cout << std::setw(m_depth) << " " << "Epsilon" << std::endl;
-    m_depth--;
-}
+void PrinterNodeVisitor::visit_switch_statement(SwitchStatement *node, int visit_count) {
+    const auto &cases = node->get_cases();
 
-void PrinterNodeVisitor::visit_number_expression_1(NumberExpression1 *node, int visit_count) {
     if (visit_count == 0) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Number Expression (1)" << std::endl;
-    } else if (visit_count == 1) {
-        if (node->get_bitwise_and()) {
-            std::cout << std::setw(m_depth) << " " << "&" << std::endl;
-        }
-    } else {
-        m_depth--;
+        m_stream << std::setw(m_depth) << " " << "Switch" << std::endl;
+        return;
     }
-}
 
-void PrinterNodeVisitor::visit_number_expression_2(NumberExpression2 *node, int visit_count) {
-    if (visit_count == 0) {
+    // The label of a case is printed before its body, the switch ends after the last one
+    size_t index = visit_count - 1;
+
+    if (visit_count == 1) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Number Expression (2)" << std::endl;
-    } else if (visit_count == 1) {
-        if (node->get_bitshift()) {
-            std::cout << std::setw(m_depth) << " " << (node->is_left() ? "<<" : ">>") << std::endl;
-        }
-    } else {
-        m_depth--;
     }
-}
 
-void PrinterNodeVisitor::visit_number_expression_3(NumberExpression3 *node, int visit_count) {
-    if (visit_count == 0) {
-        m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Number Expression (3)" << std::endl;
-    } else if (visit_count == 1) {
-        if (node->get_addition()) {
-            std::cout << std::setw(m_depth) << " " << "+" << std::endl;
+    if (index < cases.size()) {
+        m_stream << std::setw(m_depth) << " ";
+
+        if (cases[index].is_default) {
+            m_stream << "Default" << std::endl;
+        } else {
+            m_stream << "Case " << cases[index].value << std::endl;
         }
     } else {
-        m_depth--;
+        m_depth -= 2;
     }
 }
 
-void PrinterNodeVisitor::visit_number_expression_4(NumberExpression4 *node, int visit_count) {
-    if (visit_count == 0) {
-        m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Number Expression (4)" << (node->is_negated() ? " negated" : "") << std::endl;
-    } else {
-        m_depth--;
-    }
+void PrinterNodeVisitor::visit_epsilon_statement(EpsilonStatement *node, int visit_count) {
+    m_depth++;
+    m_stream << std::setw(m_depth) << " " << "Epsilon" << std::endl;
+    m_depth--;
 }
 
-void PrinterNodeVisitor::visit_number_expression_5(NumberExpression5 *node, int visit_count) {
-    if (visit_count == 0) {
-        m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Number Expression (5)" << std::endl;
-    } else {
-        m_depth--;
+static const char *binary_operator_string(BinaryOperator op) {
+    switch (op) {
+        case BitwiseAnd: return "&";
+        case ShiftRight: return ">>";
+        case Addition: return "+";
+        case Subtraction: return "-";
+        case Multiplication: return "*";
+        case Division: return "/";
+        case Modulo: return "%";
+        case LogicalOr: return "||";
+        case LogicalAnd: return "&&";
+        case Equals: return "==";
+        case NotEquals: return "!=";
+        case LessThan: return "<";
+        case GreaterThan: return ">";
+        case LessThanOrEqual: return "<=";
+        case GreaterThanOrEqual: return ">=";
     }
-}
 
-void PrinterNodeVisitor::visit_boolean_expression_1(BooleanExpression1 *node, int visit_count) {
-    if (visit_count == 0) {
-        m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Boolean Expression (1)" << std::endl;
-    } else if (visit_count == 1) {
-        if (node->get_logical_or()) {
-            std::cout << std::setw(m_depth) << " " << "||" << std::endl;
-        }
-    } else {
-        m_depth--;
-    }
+    return "?";
 }
 
-void PrinterNodeVisitor::visit_boolean_expression_2(BooleanExpression2 *node, int visit_count) {
+void PrinterNodeVisitor::visit_binary_expression(BinaryExpression *node, int visit_count) {
     if (visit_count == 0) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Boolean Expression (2)" << std::endl;
-    } else if (visit_count == 1) {
-        if (node->get_logical_and()) {
-            std::cout << std::setw(m_depth) << " " << "&&" << std::endl;
+        m_stream << std::setw(m_depth) << " " << "Binary Expression " << binary_operator_string(node->get_operator());
+        if (node->has_constant()) {
+            m_stream << " " << node->get_constant();
         }
-    } else {
+        m_stream << std::endl;
+    } else if (visit_count == 2) {
         m_depth--;
     }
 }
 
-void PrinterNodeVisitor::visit_boolean_expression_3(BooleanExpression3 *node, int visit_count) {
+void PrinterNodeVisitor::visit_unary_expression(UnaryExpression *node, int visit_count) {
     if (visit_count == 0) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Boolean Expression (3)" << (node->is_negated() ? " negated" : "") << std::endl;
+        m_stream << std::setw(m_depth) << " " << "Unary Expression " << (node->get_operator() == Negation ? "-" : "!") << std::endl;
     } else {
         m_depth--;
     }
 }
 
-void PrinterNodeVisitor::visit_boolean_expression_4(BooleanExpression4 *node, int visit_count) {
+void PrinterNodeVisitor::visit_index_expression(IndexExpression *node, int visit_count) {
     if (visit_count == 0) {
         m_depth++;
-        std::cout << std::setw(m_depth) << " " << "Boolean Expression (4)" << std::endl;
-    } else if (visit_count == 1 && node->is_comparison()) {
-        std::cout << std::setw(m_depth) << " " << (node->get_comparison() == Equals ? "==" : "<op>") << std::endl;
-    } else if (visit_count == 2) {
+        m_stream << std::setw(m_depth) << " " << (node->is_store() ? "Store " : "Load ") << node->get_identifier() << "[]" << std::endl;
+    } else {
         m_depth--;
     }
 }
 
 void PrinterNodeVisitor::visit_variable_expression(VariableExpression *node, int visit_count) {
     m_depth++;
-    std::cout << std::setw(m_depth) << " " << "Var " << node->get_identifier() << std::endl;
+    m_stream << std::setw(m_depth) << " " << "Var " << node->get_identifier() << std::endl;
     m_depth--;
 }
 
 void PrinterNodeVisitor::visit_value_expression(ValueExpression *node, int visit_count) {
     m_depth++;
-    std::cout << std::setw(m_depth) << " " << "Number " << node->get_number() << std::endl;
+    m_stream << std::setw(m_depth) << " " << "Number " << node->get_number() << std::endl;
     m_depth--;
 }
 
 void PrinterNodeVisitor::visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) {
     m_depth++;
-    std::cout << std::setw(m_depth) << " " << "Boolean " << (node->get_value() ? "true" : "false")  << std::endl;
+    m_stream << std::setw(m_depth) << " " << "Boolean " << (node->get_value() ? "true" : "false")  << std::endl;
     m_depth--;
 }
\ No newline at end of file
@@ -1,32 +1,36 @@
 #ifndef MIMA_COMPILER_DEBUG_H
 #define MIMA_COMPILER_DEBUG_H
 
+#include <ostream>
+
 #include "ast.h"
 
-class PrinterNodeVisitor : public NodeVisitor {
+class PrinterNodeVisitor : public NodeVisitor<PrinterNodeVisitor> {
 public:
-    void print_tree(Node *node) { node->visit(*this); };
+    explicit PrinterNodeVisitor(std::ostream &stream)
+        : m_stream(stream)
+    { }
+
+    void print_tree(Node *node) { visit(node); };
 
 private:
-    void visit_var_statement(VarStatement *node, int visit_count) override;
-    void visit_assignment_statement(AssignmentStatement *node, int visit_count) override;
-    void visit_origin_statement(OriginStatement *node, int visit_count) override;
-    void visit_conditional_statement(ConditionalStatement *node, int visit_count) override;
-    void visit_while_statement(WhileStatement *node, int visit_count) override;
-    void visit_epsilon_statement(EpsilonStatement *node, int visit_count) override;
-    void visit_number_expression_1(NumberExpression1 *node, int visit_count) override;
-    void visit_number_expression_2(NumberExpression2 *node, int visit_count) override;
-    void visit_number_expression_3(NumberExpression3 *node, int visit_count) override;
-    void visit_number_expression_4(NumberExpression4 *node, int visit_count) override;
-    void visit_number_expression_5(NumberExpression5 *node, int visit_count) override;
-    void visit_boolean_expression_1(BooleanExpression1 *node, int visit_count) override;
-    void visit_boolean_expression_2(BooleanExpression2 *node, int visit_count) override;
-    void visit_boolean_expression_3(BooleanExpression3 *node, int visit_count) override;
-    void visit_boolean_expression_4(BooleanExpression4 *node, int visit_count) override;
-    void visit_variable_expression(VariableExpression *node, int visit_count) override;
-    void visit_value_expression(ValueExpression *node, int visit_count) override;
-    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) override;
+    friend class NodeVisitor<PrinterNodeVisitor>;
+
+    void visit_var_statement(VarStatement *node, int visit_count);
+    void visit_assignment_statement(AssignmentStatement *node, int visit_count);
+    void visit_origin_statement(OriginStatement *node, int visit_count);
+    void visit_conditional_statement(ConditionalStatement *node, int visit_count);
+    void visit_while_statement(WhileStatement *node, int visit_count);
+    void visit_switch_statement(SwitchStatement *node, int visit_count);
+    void visit_epsilon_statement(EpsilonStatement *node, int visit_count);
+    void visit_binary_expression(BinaryExpression *node, int visit_count);
+    void visit_unary_expression(UnaryExpression *node, int visit_count);
+    void visit_index_expression(IndexExpression *node, int visit_count);
+    void visit_variable_expression(VariableExpression *node, int visit_count);
+    void visit_value_expression(ValueExpression *node, int visit_count);
+    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count);
 
+    std::ostream &m_stream;
     int m_depth{0};
 };
 
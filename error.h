@@ -0,0 +1,23 @@
+#ifndef MIMA_COMPILER_ERROR_H
+#define MIMA_COMPILER_ERROR_H
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Thrown by the lexer, parser and generator instead of terminating, so a failed compilation can be reported per file.
+// The location points into the source if it is known.
+class CompileError : public std::runtime_error {
+public:
+    explicit CompileError(const std::string &message, std::string_view location = {})
+        : std::runtime_error(message)
+        , m_location(location)
+    { }
+
+    [[nodiscard]] std::string_view location() const { return m_location; }
+
+private:
+    std::string_view m_location;
+};
+
+#endif //MIMA_COMPILER_ERROR_H
@@ -9,18 +9,12 @@ class AssignmentStatement;
 class OriginStatement;
 class ConditionalStatement;
 class WhileStatement;
+class SwitchStatement;
 class EpsilonStatement;
 
-class NumberExpression1;
-class NumberExpression2;
-class NumberExpression3;
-class NumberExpression4;
-class NumberExpression5;
-
-class BooleanExpression1;
-class BooleanExpression2;
-class BooleanExpression3;
-class BooleanExpression4;
+class BinaryExpression;
+class UnaryExpression;
+class IndexExpression;
 
 class VariableExpression;
 class ValueExpression;
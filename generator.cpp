@@ -1,185 +1,1531 @@
 #include "generator.h"
 
 #include <algorithm>
+#include <bit>
 #include <iostream>
 #include <iomanip>
+#include <optional>
 #include <utility>
 
+#include "allocations.h"
 #include "ast.h"
+#include "error.h"
+#include "passes.h"
+
+static const std::string s_aux = ".aux";
+static const std::string s_one = ".one";
+static const std::string s_m_one = ".m_one";
+static const std::string s_mask = ".mask";
+static const std::string s_sign = ".sign";
+static const std::string s_sp = ".sp";
+static const std::string s_label_prefix = ".L";
+static const std::string s_temp_prefix = ".t";
+static const std::string s_constant_prefix = ".c";
+static const std::string s_pointer_prefix = ".p";
+static const std::string s_address = ".addr";
+
+// Addresses are 20 bits wide
+static const int s_memory_size = 1 << 20;
+
+static std::string hex_address(int address) {
+    std::stringstream hex;
+    hex << "0x" << std::hex << std::uppercase << address;
+
+    return hex.str();
+}
+
+// LDC only takes a 20 bit operand, everything else is loaded from the constant pool
+static bool fits_ldc(int value) {
+    return value >= 0 && value < (1 << 20);
+}
+
+// Cells of the constant pool the generated code always relies on
+static std::vector<PoolConstant> builtin_constants() {
+    return {
+        {1, s_one, "1", "constant one"},
+        {0xFFFFFF, s_m_one, "-1", "constant minus one"},
+        {0xFFFFFE, s_mask, "0xFFFFFE", "bitmask for use in >>"},
+        {0x800000, s_sign, "0x800000", "sign bit"},
+    };
+}
+
+// Operators applied to AKKU with their right operand taken from memory, so a variable or constant needs no evaluation
+static bool takes_memory_operand(BinaryOperator op) {
+    return op != ShiftRight && op != Multiplication && op != Division && op != Modulo;
+}
+
+static bool is_comparison(BinaryOperator op) {
+    return op == Equals || op == NotEquals || op == LessThan || op == GreaterThan || op == LessThanOrEqual
+        || op == GreaterThanOrEqual;
+}
+
+// The comparison that holds exactly if the given one does not
+static BinaryOperator negated_comparison(BinaryOperator op) {
+    switch (op) {
+        case Equals: return NotEquals;
+        case NotEquals: return Equals;
+        case LessThan: return GreaterThanOrEqual;
+        case GreaterThanOrEqual: return LessThan;
+        case GreaterThan: return LessThanOrEqual;
+        default: return GreaterThan;
+    }
+}
+
+// The comparison with its operands swapped, 0 < x is x > 0
+static BinaryOperator mirrored_comparison(BinaryOperator op) {
+    switch (op) {
+        case LessThan: return GreaterThan;
+        case GreaterThan: return LessThan;
+        case LessThanOrEqual: return GreaterThanOrEqual;
+        case GreaterThanOrEqual: return LessThanOrEqual;
+        default: return op;
+    }
+}
+
+static const char *comparison_symbol(BinaryOperator op) {
+    switch (op) {
+        case Equals: return "==";
+        case NotEquals: return "!=";
+        case LessThan: return "<";
+        case GreaterThan: return ">";
+        case LessThanOrEqual: return "<=";
+        default: return ">=";
+    }
+}
+
+// The cell a comparison with the constant c applies to AKKU: c for EQL, otherwise the addend that leaves the sign
+// of left - c (<), ~left + c (>=), ~left + c + 1 = c - left (>) or left + ~c = ~(c - left) (<=)
+static int comparison_operand(BinaryOperator op, int c) {
+    switch (op) {
+        case LessThan: return -c;
+        case GreaterThan: return c + 1;
+        case LessThanOrEqual: return ~c;
+        default: return c;
+    }
+}
+
+// Limit of the left operand of a comparison if it is e & m or e % 2^k, whose value then lies in [0, m] or [0, 2^k - 1]
+static std::optional<int> operand_mask(Node *node) {
+    auto expression = node_cast<BinaryExpression>(node);
+    auto value = expression ? constant_value(expression->get_right().get()) : std::nullopt;
+
+    if (!value) {
+        return std::nullopt;
+    }
+
+    int mask = *value;
+
+    if (expression->get_operator() == Modulo && mask > 0 && std::has_single_bit((unsigned)mask)) {
+        mask -= 1;
+    } else if (expression->get_operator() != BitwiseAnd) {
+        return std::nullopt;
+    }
+
+    mask &= 0xFFFFFF;
+    return mask & 0x800000 ? std::nullopt : std::optional(mask);
+}
+
+// A masked operand compared with zero needs no constant cell, see write_sign_comparison. A boolean only needs
+// that if the mask is one.
+static bool is_zero_test(BinaryExpression *node) {
+    auto mask = node->get_left_mask();
+    BinaryOperator op = node->get_operator();
+
+    return mask && node->has_constant() && (node->get_constant() & 0xFFFFFF) == 0 && (op == Equals || op == NotEquals)
+        && (node->is_branch_condition() || *mask == 1);
+}
+
+// A comparison that is the condition of an if or while leaves the sign of AKKU to branch on instead of a boolean
+static void mark_branch_condition(Node *condition) {
+    auto comparison = node_cast<BinaryExpression>(condition);
+
+    if (comparison && is_comparison(comparison->get_operator())) {
+        comparison->set_branch_condition(true);
+    }
+}
+
+static bool is_branch_condition(Node *condition) {
+    auto comparison = node_cast<BinaryExpression>(condition);
+    return comparison && comparison->is_branch_condition();
+}
+
+// Words of a right shift loop by a constant count
+static const int s_shift_loop_size = 21;
+
+// Cases a switch compares one after another instead of splitting them further
+static const size_t s_linear_cases = 3;
+
+// A jump table needs this many cases and may have up to this many entries per case
+static const size_t s_min_table_cases = 4;
+static const long s_table_entries_per_case = 3;
+
+// Opcode of JMP in the upper four bits of an instruction word
+static const int s_jump_opcode = 0x800000;
+
+// Nodes the addition chain search may expand before falling back to the binary method
+static const size_t s_addition_chain_budget = 100000;
+
+// The constant c of an assignment x = x + c, x = c + x or x = x - c
+static std::optional<int> linear_step(AssignmentStatement *node) {
+    auto expression = node_cast<BinaryExpression>(node->get_expression().get());
+
+    if (node->get_element() || !expression) {
+        return std::nullopt;
+    }
+
+    auto is_variable = [node](const std::shared_ptr<Node> &operand) {
+        auto variable = node_cast<VariableExpression>(operand.get());
+        return variable && variable->get_identifier() == node->get_identifier();
+    };
+
+    if (expression->get_operator() == Addition && is_variable(expression->get_left())) {
+        return constant_value(expression->get_right().get());
+    } else if (expression->get_operator() == Addition && is_variable(expression->get_right())) {
+        return constant_value(expression->get_left().get());
+    } else if (expression->get_operator() == Subtraction && is_variable(expression->get_left())) {
+        auto step = constant_value(expression->get_right().get());
+        return step ? std::optional(-*step) : std::nullopt;
+    }
+
+    return std::nullopt;
+}
+
+// Splits an index x, x + c, c + x or x - c into x and c
+static bool linear_index(Node *index, std::string_view &variable, int &offset) {
+    if (auto expression = node_cast<VariableExpression>(index)) {
+        variable = expression->get_identifier();
+        offset = 0;
+        return true;
+    }
+
+    auto expression = node_cast<BinaryExpression>(index);
+
+    if (!expression || (expression->get_operator() != Addition && expression->get_operator() != Subtraction)) {
+        return false;
+    }
+
+    auto left = node_cast<VariableExpression>(expression->get_left().get());
+    auto right = node_cast<VariableExpression>(expression->get_right().get());
+    std::optional<int> constant;
+
+    if (left) {
+        variable = left->get_identifier();
+        constant = constant_value(expression->get_right().get());
+    } else if (right && expression->get_operator() == Addition) {
+        variable = right->get_identifier();
+        constant = constant_value(expression->get_left().get());
+    }
+
+    if (!constant) {
+        return false;
+    }
+
+    offset = expression->get_operator() == Subtraction ? -*constant : *constant;
+    return true;
+}
+
+// Collects the assignments and array elements in a loop
+class LoopScanner : public NodeVisitor<LoopScanner> {
+public:
+    [[nodiscard]] const std::vector<AssignmentStatement *> &get_assignments() const { return m_assignments; }
+    [[nodiscard]] const std::vector<IndexExpression *> &get_elements() const { return m_elements; }
+
+private:
+    friend class NodeVisitor<LoopScanner>;
+
+    void visit_var_statement(VarStatement *node, int visit_count) { }
+    void visit_assignment_statement(AssignmentStatement *node, int visit_count) {
+        if (visit_count == 0) { m_assignments.push_back(node); }
+    }
+    void visit_origin_statement(OriginStatement *node, int visit_count) { }
+    void visit_conditional_statement(ConditionalStatement *node, int visit_count) { }
+    void visit_while_statement(WhileStatement *node, int visit_count) { }
+    void visit_switch_statement(SwitchStatement *node, int visit_count) { }
+    void visit_epsilon_statement(EpsilonStatement *node, int visit_count) { }
+    void visit_binary_expression(BinaryExpression *node, int visit_count) { }
+    void visit_unary_expression(UnaryExpression *node, int visit_count) { }
+    void visit_index_expression(IndexExpression *node, int visit_count) {
+        if (visit_count == 0) { m_elements.push_back(node); }
+    }
+    void visit_variable_expression(VariableExpression *node, int visit_count) { }
+    void visit_value_expression(ValueExpression *node, int visit_count) { }
+    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) { }
+
+    std::vector<AssignmentStatement *> m_assignments{};
+    std::vector<IndexExpression *> m_elements{};
+};
+
+// The case values of a switch with the 24 bit wrap-around of AKKU, sorted, without the default case
+static std::vector<SwitchEntry> sorted_cases(SwitchStatement *node) {
+    const auto &cases = node->get_cases();
+    std::vector<SwitchEntry> entries;
+
+    for (size_t index = 0; index < cases.size(); index++) {
+        if (!cases[index].is_default) {
+            int value = cases[index].value & 0xFFFFFF;
+            entries.push_back({value & 0x800000 ? value - 0x1000000 : value, index});
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const SwitchEntry &left, const SwitchEntry &right) {
+        return left.value < right.value || (left.value == right.value && left.index < right.index);
+    });
+
+    for (size_t index = 1; index < entries.size(); index++) {
+        if (entries[index].value == entries[index - 1].value) {
+            std::string_view label = cases[entries[index].index].label;
+            throw CompileError("Multiple cases '" + std::string(label) + "' found", label);
+        }
+    }
+
+    return entries;
+}
+
+// Index the search splits the cases [first, last) at. Comparing by subtraction is exact for values less than
+// half the range apart, cases further apart are split by their sign first.
+static size_t split_cases(const std::vector<SwitchEntry> &entries, size_t first, size_t last, bool &by_sign) {
+    by_sign = (long)entries[last - 1].value - entries[first].value >= 0x800000;
+
+    if (by_sign) {
+        return std::find_if(entries.begin() + (long)first, entries.begin() + (long)last, [](const SwitchEntry &entry) {
+            return entry.value >= 0;
+        }) - entries.begin();
+    }
+
+    return first + (last - first) / 2;
+}
+
+// Magnitude of a 24 bit factor; negative factors are multiplied by their magnitude and negated afterwards
+static int factor_magnitude(int factor, bool &negate) {
+    int magnitude = factor & 0xFFFFFF;
+    negate = magnitude & 0x800000;
+
+    return negate ? 0x1000000 - magnitude : magnitude;
+}
+
+// Iterative deepening over star chains; the cost of a step is its ADD plus the STV of a newly reused addend
+static bool search_addition_chain(AdditionChain &chain, std::vector<bool> &kept, int target, int cost, int bound, size_t &budget) {
+    int current = chain.values.back();
+
+    if (current == target) {
+        return true;
+    }
+
+    if (budget == 0) {
+        return false;
+    }
+    budget--;
+
+    int steps = 0;
+    for (long value = current; value < target; value *= 2) {
+        steps++;
+    }
+
+    if (cost + steps > bound) {
+        return false;
+    }
+
+    for (size_t addend = chain.values.size(); addend-- > 0;) {
+        long value = (long)current + chain.values[addend];
+
+        if (value > target) {
+            continue;
+        }
+
+        bool store = !kept[addend];
+        kept[addend] = true;
+        chain.values.push_back((int)value);
+        chain.addends.push_back(addend);
+        kept.push_back(false);
+
+        if (search_addition_chain(chain, kept, target, cost + 1 + store, bound, budget)) {
+            return true;
+        }
+
+        kept.pop_back();
+        chain.addends.pop_back();
+        chain.values.pop_back();
+        kept[addend] = !store;
+    }
+
+    return false;
+}
+
+// Assigns temporaries to all chain values that are reused as addends, sharing cells once a value is dead
+static std::vector<int> assign_chain_cells(const AdditionChain &chain, size_t &cell_count) {
+    std::vector<size_t> last_use(chain.values.size(), 0);
+
+    for (size_t step = 0; step < chain.addends.size(); step++) {
+        last_use[chain.addends[step]] = step + 1;
+    }
+
+    std::vector<int> cells(chain.values.size(), -1);
+    std::vector<size_t> free_after{};
+
+    for (size_t index = 0; index < chain.values.size(); index++) {
+        if (last_use[index] == 0) {
+            continue;
+        }
+
+        auto cell = std::find_if(free_after.begin(), free_after.end(), [&](size_t after) { return after <= index; });
+
+        if (cell == free_after.end()) {
+            cells[index] = (int)free_after.size();
+            free_after.push_back(last_use[index]);
+        } else {
+            cells[index] = (int)(cell - free_after.begin());
+            *cell = last_use[index];
+        }
+    }
+
+    cell_count = free_after.size();
+    return cells;
+}
+
+std::string GeneratorNodeVisitor::generate(std::shared_ptr<Node> tree) {
+    std::stringstream output;
+    m_output = &output;
+
+    {
+        AllocationPhase phase("declare");
+        declare(tree.get());
+    }
+
+    // The program is generated first, the stack depth decides whether the header has a stack pointer
+    m_regions.push_back({0, 0});
+
+    {
+        AllocationPhase phase("emit");
+        visit(tree.get());
+        write_program_end();
+    }
+
+    std::string program = output.str();
+    output.str("");
+
+    int register_count = write_registers(m_regions.front());
+    output << program;
+
+    // The registers moved the program of the first region back
+    for (auto &mapping : m_locations) {
+        if (mapping.region == 0) {
+            mapping.address += register_count;
+        }
+    }
+
+    return output.str();
+}
+
+// Without the header in front nothing has to be kept, so every line goes to the stream as soon as it is generated
+void GeneratorNodeVisitor::generate(std::shared_ptr<Node> tree, std::ostream &output) {
+    m_output = &output;
+    m_streamed = true;
+
+    {
+        AllocationPhase phase("declare");
+        declare(tree.get());
+    }
+
+    m_regions.push_back({0, 0});
+
+    AllocationPhase phase("emit");
+    visit(tree.get());
+    write_program_end();
+    write_registers(m_regions.back());
+}
+
+// First pass: collects the declarations, labels, temporaries and pointers and sizes the columns
+void GeneratorNodeVisitor::declare(Node *tree) {
+    m_constants = builtin_constants();
+
+    visit(tree);
+    m_first_pass = false;
+    m_next_label = "";
+
+    add_identifier(s_aux);
+    add_identifier(s_sp);
+
+    if (!m_array_sizes.empty()) {
+        add_identifier(s_address);
+    }
+
+    declare_cells();
+
+    if (m_log) {
+        *m_log << "Declared Identifiers:" << std::endl;
+        for (auto identifier : m_identifiers) {
+            *m_log << identifier << std::endl;
+        }
+        *m_log << std::endl;
+    }
+
+    for (auto identifier : m_identifiers) {
+        if (identifier.size() > m_max_lpad) {
+            m_max_lpad = identifier.size();
+        }
+    }
+
+    for (const auto &constant : m_constants) {
+        if (constant.name.size() > m_max_lpad) {
+            m_max_lpad = constant.name.size();
+        }
+    }
+
+    size_t max_label_size = s_label_prefix.size() + std::to_string(m_label_count).size();
+    if (max_label_size > m_max_lpad) {
+        m_max_lpad = max_label_size;
+    }
+
+    m_max_rpad = m_max_lpad < 8 ? 8 : m_max_lpad;
+}
+
+// Names the pointers and temporaries the first pass asked for so far
+void GeneratorNodeVisitor::declare_cells() {
+    while (m_pointers.size() < m_pointer_count) {
+        m_pointers.push_back(s_pointer_prefix + std::to_string(m_pointers.size()));
+        add_identifier(m_pointers.back());
+    }
+
+    while (m_temporaries.size() < m_temp_count) {
+        m_temporaries.push_back(s_temp_prefix + std::to_string(m_temporaries.size()));
+        add_identifier(m_temporaries.back());
+    }
+}
+
+void GeneratorNodeVisitor::begin(std::ostream &output) {
+    m_output = &output;
+    m_streamed = true;
+    m_constants = builtin_constants();
+
+    add_identifier(s_aux);
+    add_identifier(s_sp);
+    add_identifier(s_address);
+
+    m_regions.push_back({0, 0});
+}
+
+// Both passes over one statement; everything the first pass learns about other statements is their declarations
+void GeneratorNodeVisitor::generate_statement(Statement *statement) {
+    {
+        AllocationPhase phase("declare");
+        m_first_pass = true;
+        visit(statement);
+        declare_cells();
+    }
+
+    AllocationPhase phase("emit");
+    m_first_pass = false;
+    visit(statement);
+
+    // The statement is freed after this, so its nodes must not be found again by a new one at the same address
+    m_loop_pointers.clear();
+    m_pointer_steps.clear();
+}
+
+void GeneratorNodeVisitor::end() {
+    write_program_end();
+    write_registers(m_regions.back());
+}
+
+void GeneratorNodeVisitor::write_program_end() {
+    m_location = {};
+
+    // TODO: Find syntax to determine HALT
+    write_line("", "HALT", "");
+
+    for (const auto &constant : m_constants) {
+        if (constant.referenced) {
+            write_line(constant.name, "DS", constant.operand, constant.comment);
+        }
+    }
+}
+
+// Declares the registers, temporaries and pointers in the given region, which grows by their cells. Returns their number.
+int GeneratorNodeVisitor::write_registers(std::pair<int, int> &region) {
+    size_t register_count = 1 + (m_max_stack_depth > 0) + m_temporaries.size() + !m_array_sizes.empty() + m_pointers.size();
+    region.second += (int)register_count;
+
+    std::string stack_pointer;
+    std::string stack_comment;
+
+    if (m_max_stack_depth > 0) {
+        place_stack(stack_pointer, stack_comment);
+    }
+
+    write_line(s_aux, "DS", "", "second general purpose register");
+
+    if (!stack_pointer.empty()) {
+        write_line(s_sp, "DS", stack_pointer, stack_comment);
+    }
+
+    for (const auto &temporary : m_temporaries) {
+        write_line(temporary, "DS", "", "temporary for * / %");
+    }
+
+    if (!m_array_sizes.empty()) {
+        write_line(s_address, "DS", "", "address of an array element");
+    }
+
+    for (const auto &pointer : m_pointers) {
+        write_line(pointer, "DS", "", "pointer into an array in a loop");
+    }
+
+    return (int)register_count;
+}
+
+void GeneratorNodeVisitor::add_identifier(std::string_view identifier) {
+    if (std::find(m_identifiers.begin(), m_identifiers.end(), identifier) != m_identifiers.end()) {
+        throw CompileError("Multiple declarations of '" + std::string(identifier) + "' found", identifier);
+    }
+
+    m_identifiers.push_back(identifier);
+}
+
+void GeneratorNodeVisitor::check_is_declared(std::string_view identifier) {
+    if (std::find(m_identifiers.begin(), m_identifiers.end(), identifier) == m_identifiers.end()) {
+        throw CompileError("No declaration of '" + std::string(identifier) + "' found", identifier);
+    }
+}
+
+void GeneratorNodeVisitor::check_kind(std::string_view identifier, bool array) {
+    check_is_declared(identifier);
+
+    if (m_array_sizes.count(identifier) != array) {
+        throw CompileError("'" + std::string(identifier) + (array ? "' is not an array" : "' is an array"), identifier);
+    }
+}
+
+std::string GeneratorNodeVisitor::create_label() {
+    std::string label;
+    label += s_label_prefix;
+    label += std::to_string(m_label_index++);
+
+    return label;
+}
+
+void GeneratorNodeVisitor::set_next_label(const std::string &label) {
+    flush_next_label(label);
+    m_next_label = label;
+}
+
+void GeneratorNodeVisitor::flush_next_label(std::string_view label) {
+    // A line only takes one label, so a pending one gets a jump to the following line
+    if (!m_next_label.empty()) {
+        write_line("", "JMP", std::string(label), "fall through");
+    }
+}
+
+void GeneratorNodeVisitor::write_padded_identifier(std::string_view identifier) {
+    if (!m_next_label.empty()) {
+        identifier = m_next_label;
+    }
+
+    int padding = m_streamed ? 0 : (int)(m_max_lpad - identifier.size());
+
+    if (padding) {
+        *m_output << std::setw(padding) << " ";
+    }
+
+    *m_output << identifier;
+
+    if (!m_next_label.empty()) {
+        m_next_label = "";
+    }
+}
+
+void GeneratorNodeVisitor::write_instruction(std::string instruction) {
+    if (m_streamed) {
+        *m_output << '\t' << instruction << '\t';
+    } else {
+        *m_output << " " << std::setw(4) << instruction << " ";
+    }
+}
+
+void GeneratorNodeVisitor::write_hex(int number) {
+    if (number < 0) {
+        number *= -1;
+        number |= (1 << 23);
+    }
+
+    std::stringstream hex;
+    hex << "0x" << std::hex << number << std::dec;
+
+    *m_output << hex.str();
+    m_last_operand_size = hex.str().size();
+}
+
+void GeneratorNodeVisitor::write_number(int number) {
+    std::stringstream num;
+    num << number;
+    *m_output << num.str();
+    m_last_operand_size = num.str().size();
+}
+
+void GeneratorNodeVisitor::write_identifier(std::string_view identifier) {
+    *m_output << identifier;
+    m_last_operand_size = identifier.size();
+}
+
+void GeneratorNodeVisitor::write_comment(const std::string& comment) {
+    if (comment.empty()) {
+        return;
+    }
+
+    if (m_streamed) {
+        *m_output << "\t;" << comment;
+        return;
+    }
+
+    int padding = (int) (m_max_rpad - m_last_operand_size);
+
+    if (padding) {
+        *m_output << std::setw(padding) << " ";
+    }
+
+    *m_output << " ;" << comment;
+}
+
+void GeneratorNodeVisitor::write_end_line() {
+    *m_output << '\n';
+}
+
+void GeneratorNodeVisitor::write_line(std::string_view identifier, std::string instruction, std::string operand, std::string comment)
+{
+    if (!identifier.empty()) {
+        flush_next_label(identifier);
+    }
+
+    if (!identifier.empty() || !m_next_label.empty()) {
+        // Labels can be reached from anywhere, so nothing is known about AKKU
+        invalidate_accumulator();
+    } else if (m_optimizations.track_accumulator && is_redundant(instruction, operand)) {
+        return;
+    }
+
+    track_accumulator(instruction, operand);
+    mark_referenced(operand);
+    map_location();
+    m_regions.back().second++;
+
+    write_padded_identifier(identifier);
+    write_instruction(std::move(instruction));
+    write_identifier(operand);
+    write_comment(comment);
+    write_end_line();
+}
+
+// Called before the word is counted, so the end of the region is its address
+void GeneratorNodeVisitor::map_location() {
+    if (m_map_locations && !m_location.empty()) {
+        m_locations.push_back({m_regions.size() - 1, m_regions.back().second, m_location});
+    }
+}
+
+bool GeneratorNodeVisitor::is_redundant(const std::string &instruction, const std::string &operand) const {
+    if (instruction == "LDV" || instruction == "STV") {
+        return std::find(m_akku_cells.begin(), m_akku_cells.end(), operand) != m_akku_cells.end();
+    } else if (instruction == "LDIV") {
+        return std::find(m_akku_addresses.begin(), m_akku_addresses.end(), operand) != m_akku_addresses.end();
+    } else if (instruction == "LDC") {
+        return !m_akku_constant.empty() && m_akku_constant == operand;
+    }
+
+    return false;
+}
+
+void GeneratorNodeVisitor::track_accumulator(const std::string &instruction, const std::string &operand) {
+    if (instruction == "LDV") {
+        invalidate_accumulator();
+        m_akku_cells.push_back(operand);
+    } else if (instruction == "LDC") {
+        invalidate_accumulator();
+        m_akku_constant = operand;
+    } else if (instruction == "STV") {
+        // The cell may have held the address of an element equal to AKKU
+        std::erase(m_akku_addresses, operand);
+        m_akku_cells.push_back(operand);
+    } else if (instruction == "LDIV") {
+        invalidate_accumulator();
+        m_akku_addresses.push_back(operand);
+    } else if (instruction == "STIV") {
+        // The element may be the one behind any other address, named cells are never written this way
+        m_akku_addresses = {operand};
+    } else if (instruction != "JMN" && instruction != "JMP") {
+        // Jumps leave AKKU untouched, everything else changes it
+        invalidate_accumulator();
+    }
+}
+
+void GeneratorNodeVisitor::invalidate_accumulator() {
+    m_akku_cells.clear();
+    m_akku_addresses.clear();
+    m_akku_constant.clear();
+}
+
+std::string GeneratorNodeVisitor::constant(int value) {
+    int cell = value & 0xFFFFFF;
+
+    for (const auto &constant : m_constants) {
+        if (constant.value == cell) {
+            return constant.name;
+        }
+    }
+
+    std::stringstream hex;
+    hex << std::hex << std::uppercase << cell;
+
+    m_constants.push_back({cell, s_constant_prefix + hex.str(), "0x" + hex.str(), "constant"});
+    return m_constants.back().name;
+}
+
+void GeneratorNodeVisitor::mark_referenced(const std::string &operand) {
+    if (operand.empty() || operand.front() != '.') {
+        return;
+    }
+
+    for (auto &constant : m_constants) {
+        if (constant.name == operand) {
+            constant.referenced = true;
+            return;
+        }
+    }
+}
+
+void GeneratorNodeVisitor::write_load_constant(int value, const std::string &comment) {
+    if (fits_ldc(value)) {
+        write_line("", "LDC", std::to_string(value), comment);
+    } else {
+        write_line("", "LDV", constant(value), comment);
+    }
+}
+
+// Places the stack after the program unless a base is given and sizes it to the deepest push unless a size is given.
+// Every push is popped again within the same expression and there are no calls, so the stack is empty whenever control
+// jumps between statements and the deepest push in the generated code is the exact depth at runtime.
+void GeneratorNodeVisitor::place_stack(std::string &stack_pointer, std::string &comment) {
+    int depth = (int)m_max_stack_depth;
+    int size = m_stack.size.value_or(depth);
+
+    if (size < depth) {
+        throw CompileError("Stack size " + std::to_string(size) + " is smaller than the required depth of " + std::to_string(depth),
+                           m_deepest_push);
+    }
+
+    int base = 0;
+    for (const auto &region : m_regions) {
+        base = std::max(base, region.second);
+    }
+    base = m_stack.base.value_or(base);
+
+    if (base < 0 || base + size > s_memory_size) {
+        throw CompileError("Stack at " + hex_address(base) + " with " + std::to_string(size) + " cells does not fit into memory",
+                           m_deepest_push);
+    }
+
+    for (const auto &region : m_regions) {
+        if (region.first < base + size && base < region.second) {
+            throw CompileError("Stack " + hex_address(base) + " - " + hex_address(base + size - 1) + " overlaps the program "
+                + hex_address(region.first) + " - " + hex_address(region.second - 1), m_deepest_push);
+        }
+    }
+
+    // Pushes store at the stack pointer before decrementing it
+    stack_pointer = hex_address(base + size - 1);
+    comment = "stack " + hex_address(base) + " - " + stack_pointer;
+}
+
+void GeneratorNodeVisitor::push() {
+    if (++m_stack_depth > m_max_stack_depth) {
+        m_max_stack_depth = m_stack_depth;
+        m_deepest_push = m_location;
+    }
+
+    write_line("", "STIV", s_sp);
+    write_line("", "LDV", s_sp);
+    write_line("", "ADD", s_m_one);
+    write_line("", "STV", s_sp, "push AKKU -> <sp>; sp--");
+}
+
+void GeneratorNodeVisitor::pop() {
+    m_stack_depth--;
+
+    write_line("", "LDV", s_sp);
+    write_line("", "ADD", s_one);
+    write_line("", "STV", s_sp);
+    write_line("", "LDIV", s_sp, "pop <sp + 1> -> AKKU; sp++");
+}
+
+const AdditionChain &GeneratorNodeVisitor::addition_chain(int factor) {
+    auto cached = m_addition_chains.find(factor);
+    if (cached != m_addition_chains.end()) {
+        return cached->second;
+    }
+
+    // Left-to-right binary method as upper bound and fallback
+    AdditionChain binary{{1}, {}};
+    int binary_cost = 0;
+    bool one_kept = false;
+
+    for (int bit = std::bit_width((unsigned)factor) - 2; bit >= 0; bit--) {
+        binary.addends.push_back(binary.values.size() - 1);
+        binary.values.push_back(binary.values.back() * 2);
+        binary_cost += 2;
+
+        if (factor & (1 << bit)) {
+            binary.addends.push_back(0);
+            binary.values.push_back(binary.values.back() + 1);
+            binary_cost += one_kept ? 1 : 2;
+        }
+
+        one_kept = true;
+    }
+
+    if (!m_optimizations.search_addition_chains) {
+        return m_addition_chains[factor] = binary;
+    }
+
+    size_t budget = s_addition_chain_budget;
+
+    for (int bound = 0; bound < binary_cost && budget > 0; bound++) {
+        AdditionChain chain{{1}, {}};
+        std::vector<bool> kept{false};
+
+        if (search_addition_chain(chain, kept, factor, 0, bound, budget)) {
+            return m_addition_chains[factor] = chain;
+        }
+    }
+
+    return m_addition_chains[factor] = binary;
+}
+
+void GeneratorNodeVisitor::fold_constant_operand(BinaryExpression *node) {
+    auto constant = constant_value(node->get_right().get());
+
+    if (!constant && node->get_operator() == Multiplication) {
+        constant = constant_value(node->get_left().get());
+
+        if (constant) {
+            node->set_left(node->get_right());
+        }
+    }
+
+    if (constant) {
+        node->set_constant(*constant);
+        node->set_right(nullptr);
+    }
+}
+
+void GeneratorNodeVisitor::fold_direct_operand(BinaryExpression *node) {
+    Node *right = node->get_right().get();
+
+    if (auto variable = node_cast<VariableExpression>(right)) {
+        node->set_direct_operand(std::string(variable->get_identifier()));
+        node->set_right(nullptr);
+    } else if (auto element = node_cast<IndexExpression>(right); element && !element->get_element().empty()) {
+        node->set_direct_operand(element->get_element());
+        node->set_right(nullptr);
+    } else if (auto value = constant_value(right)) {
+        node->set_direct_operand(constant(*value));
+        node->set_right(nullptr);
+    }
+}
+
+void GeneratorNodeVisitor::write_constant_multiplication(int factor) {
+    bool negate;
+    int magnitude = factor_magnitude(factor, negate);
+
+    if (magnitude == 0) {
+        write_line("", "LDC", "0", "calculate multiplication by zero");
+        return;
+    }
+
+    const AdditionChain &chain = addition_chain(magnitude);
+    size_t cell_count;
+    std::vector<int> cells = assign_chain_cells(chain, cell_count);
+
+    std::vector<std::string> names(cells.size());
+    for (size_t index = 0; index < cells.size(); index++) {
+        if (cells[index] >= 0) {
+            names[index] = m_temporaries[cells[index]];
+        }
+    }
+
+    // The multiplicand does not need a temporary if it is still stored in a variable
+    if (cells[0] >= 0) {
+        for (const auto &cell : m_akku_cells) {
+            if (cell.front() != '.') {
+                names[0] = cell;
+                break;
+            }
+        }
+    }
+
+    for (size_t index = 0; index < chain.values.size(); index++) {
+        if (cells[index] >= 0) {
+            write_line("", "STV", names[index]);
+        }
+
+        if (index < chain.addends.size()) {
+            std::string comment = "AKKU * " + std::to_string(chain.values[index + 1]);
+            write_line("", "ADD", names[chain.addends[index]], comment);
+        }
+    }
+
+    if (negate) {
+        write_line("", "NOT", "");
+        write_line("", "ADD", s_one, "calculate negation of product");
+    }
+}
+
+void GeneratorNodeVisitor::write_multiplication() {
+    // left on stack; right in AKKU
+    const std::string &multiplicand = m_temporaries[0];
+    const std::string &multiplier = m_temporaries[1];
+    const std::string &product = m_temporaries[2];
+
+    std::string labelLoop = create_label();
+    std::string labelSkip = create_label();
+    std::string labelFinally = create_label();
+
+    write_line("", "STV", multiplier);
+    pop();
+    write_line("", "STV", multiplicand);
+    write_line("", "LDC", "0");
+    write_line("", "STV", product, "calculate multiplication");
+    write_line(labelLoop, "LDC", "0");
+    write_line("", "EQL", multiplier);
+    write_line("", "JMN", labelFinally, "stop once all bits are shifted out");
+    write_line("", "LDV", multiplier);
+    write_line("", "AND", s_one);
+    write_line("", "ADD", s_m_one);
+    write_line("", "JMN", labelSkip, "skip if lowest bit is clear");
+    write_line("", "LDV", product);
+    write_line("", "ADD", multiplicand);
+    write_line("", "STV", product);
+    write_line(labelSkip, "LDV", multiplicand);
+    write_line("", "ADD", multiplicand);
+    write_line("", "STV", multiplicand, "multiplicand << 1");
+    write_line("", "LDV", multiplier);
+    write_line("", "AND", s_mask);
+    write_line("", "RAR", "");
+    write_line("", "STV", multiplier, "multiplier >> 1");
+    write_line("", "JMP", labelLoop);
+    write_line(labelFinally, "LDV", product);
+}
+
+void GeneratorNodeVisitor::write_constant_division(int divisor) {
+    int shift = std::countr_zero((unsigned)divisor);
+
+    for (int i = 0; i < shift; i++) {
+        write_line("", "AND", s_mask);
+        write_line("", "RAR", "", i == shift - 1 ? "calculate division" : "");
+    }
+}
+
+void GeneratorNodeVisitor::write_constant_modulo(int divisor) {
+    if (divisor == 1) {
+        write_line("", "LDC", "0", "calculate modulo one");
+        return;
+    }
+
+    write_line("", "AND", constant(divisor - 1), "calculate modulo");
+}
+
+void GeneratorNodeVisitor::register_multiplicative(BinaryExpression *node) {
+    fold_constant_operand(node);
+
+    if (node->get_operator() != Multiplication) {
+        int divisor = node->get_constant();
+
+        if (!node->has_constant() || divisor <= 0 || !std::has_single_bit((unsigned)divisor)) {
+            throw CompileError("Only unsigned division by constant powers of two is supported", node->get_location());
+        }
+
+        if (node->get_operator() == Modulo && divisor > 1) {
+            constant(divisor - 1);
+        }
+    } else if (node->has_constant()) {
+        bool negate;
+        int magnitude = factor_magnitude(node->get_constant(), negate);
+
+        if (magnitude != 0) {
+            size_t cell_count;
+            assign_chain_cells(addition_chain(magnitude), cell_count);
+            m_temp_count = std::max(m_temp_count, cell_count);
+        }
+    } else {
+        m_temp_count = std::max(m_temp_count, (size_t)3);
+        m_label_count += 3;
+    }
+}
+
+void GeneratorNodeVisitor::write_multiplicative(BinaryExpression *node) {
+    if (!node->has_constant()) {
+        write_multiplication();
+        return;
+    }
+
+    switch (node->get_operator()) {
+        case Multiplication:
+            write_constant_multiplication(node->get_constant());
+            break;
+        case Division:
+            write_constant_division(node->get_constant());
+            break;
+        default:
+            write_constant_modulo(node->get_constant());
+            break;
+    }
+}
+
+// A constant count is unrolled into AND/RAR pairs, unless they are longer than the loop and speed is not all that counts
+void GeneratorNodeVisitor::fold_shift_count(BinaryExpression *node) {
+    auto count = constant_value(node->get_right().get());
+    if (count) {
+        count = wrap(*count);
+    }
+
+    if (!m_optimizations.unroll_shifts || !count || (!m_optimizations.unroll_long_shifts && *count < 24 && 2 * *count > s_shift_loop_size)) {
+        // The loop keeps the value in a temporary, a variable or constant count is loaded from its cell
+        m_label_count += 2;
+        m_temp_count = std::max(m_temp_count, (size_t)1);
+        constant(-24);
+        fold_direct_operand(node);
+        return;
+    }
+
+    node->set_constant(*count);
+    node->set_right(nullptr);
+}
+
+// Like the loop, a count that is negative as a 24 bit word leaves the value unchanged
+void GeneratorNodeVisitor::write_constant_shift_right(int count) {
+    count = wrap(count);
+
+    if (count >= 24) {
+        write_line("", "LDC", "0", "calculate right shift by " + std::to_string(count));
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        write_line("", "AND", s_mask);
+        write_line("", "RAR", "", i == count - 1 ? "calculate right shift by " + std::to_string(count) : "");
+    }
+}
+
+// Shifts the value by the count in the given cell, or on the stack with the count in AKKU if there is none.
+// The value stays in a temporary and the remaining count in .aux, the loop ends early once no bits are left
+// and a count of 24 or more shifts everything out without looping.
+void GeneratorNodeVisitor::write_shift_right(const std::string &count) {
+    std::string labelRepeat = create_label();
+    std::string labelFinally = create_label();
+    const std::string &value = m_temporaries[0];
+
+    if (count.empty()) {
+        write_line("", "STV", s_aux);
+        pop();
+        write_line("", "STV", value);
+        write_line("", "LDV", s_aux);
+    } else {
+        write_line("", "STV", value);
+        write_line("", "LDV", count);
+    }
+
+    write_line("", "JMN", labelFinally, "no shift by a negative count");
+    write_line("", "STV", s_aux);
+    write_line("", "ADD", constant(-24));
+    write_line("", "JMN", labelRepeat);
+    write_line("", "LDC", "0");
+    write_line("", "STV", value, "all bits shifted out");
+    write_line("", "JMP", labelFinally);
+    write_line(labelRepeat, "LDV", s_aux);
+    write_line("", "ADD", s_m_one);
+    write_line("", "JMN", labelFinally, "count aux to zero");
+    write_line("", "STV", s_aux);
+    write_line("", "LDV", value);
+    write_line("", "AND", s_mask);
+    write_line("", "RAR", "", "shift one bit out");
+    write_line("", "STV", value);
+    // The shifted value is not negative, so it is zero if it is negative after subtracting one
+    write_line("", "ADD", s_m_one);
+    write_line("", "JMN", labelFinally, "stop once no bits are left");
+    write_line("", "JMP", labelRepeat);
+    write_line(labelFinally, "LDV", value, "calculate right shift");
+}
+
+// AKKU - operand as ~(~AKKU + operand)
+void GeneratorNodeVisitor::write_subtraction(const std::string &operand, const std::string &comment) {
+    write_line("", "NOT", "");
+    write_line("", "ADD", operand);
+    write_line("", "NOT", "", comment);
+}
+
+// operand - AKKU as -AKKU + operand
+void GeneratorNodeVisitor::write_reverse_subtraction(const std::string &operand, const std::string &comment) {
+    write_line("", "NOT", "");
+    write_line("", "ADD", s_one);
+    write_line("", "ADD", operand, comment);
+}
+
+// Leaves AKKU negative exactly if left (AKKU) comparison right holds, so a JMN can branch on it.
+// The right operand is the given cell or the constant folded into the node.
+void GeneratorNodeVisitor::write_sign_comparison(BinaryOperator comparison, BinaryExpression *node, const std::string &operand) {
+    if (is_zero_test(node)) {
+        // The left operand lies in [0, mask], so left - 1 is negative if it is zero and -left if it is not
+        if (comparison == Equals) {
+            write_line("", "ADD", s_m_one, "negative if zero");
+        } else {
+            write_line("", "NOT", "");
+            write_line("", "ADD", s_one, "negative if not zero");
+        }
+        return;
+    }
+
+    if (node->has_constant()) {
+        int value = comparison_operand(comparison, node->get_constant());
+
+        if (comparison == GreaterThan || comparison == GreaterThanOrEqual) {
+            write_line("", "NOT", "");
+        }
+
+        if (comparison == Equals || comparison == NotEquals) {
+            write_line("", "EQL", constant(value));
+        } else if ((value & 0xFFFFFF) != 0) {
+            write_line("", "ADD", constant(value));
+        }
+
+        if (comparison == NotEquals) {
+            write_line("", "NOT", "");
+        }
+        return;
+    }
+
+    switch (comparison) {
+        case Equals:
+            write_line("", "EQL", operand);
+            break;
+        case NotEquals:
+            write_line("", "EQL", operand);
+            write_line("", "NOT", "");
+            break;
+        case LessThan:
+            write_subtraction(operand, "calculate left (AKKU) - right");
+            break;
+        case GreaterThanOrEqual:
+            // ~left + right is ~(left - right)
+            write_line("", "NOT", "");
+            write_line("", "ADD", operand, "calculate ~(left (AKKU) - right)");
+            break;
+        case GreaterThan:
+            write_reverse_subtraction(operand, "calculate right - left (AKKU)");
+            break;
+        default:
+            write_reverse_subtraction(operand, "");
+            write_line("", "NOT", "", "calculate ~(right - left (AKKU))");
+            break;
+    }
+}
+
+// Comparisons are lowered to the sign of AKKU; the condition of an if or while branches on it directly,
+// anything else turns it into the boolean (0, 1)
+void GeneratorNodeVisitor::write_comparison(BinaryExpression *node, const std::string &operand) {
+    BinaryOperator comparison = node->get_operator();
+    std::string comment = std::string("calculate boolean ") + comparison_symbol(comparison);
+
+    if (node->is_branch_condition()) {
+        write_sign_comparison(negated_comparison(comparison), node, operand);
+        return;
+    }
+
+    if (comparison == Equals || comparison == NotEquals) {
+        if (is_zero_test(node)) {
+            // A value masked by one already is the boolean of != 0
+            if (comparison == Equals) {
+                write_line("", "XOR", s_one, comment);
+            }
+            return;
+        }
+
+        // EQL leaves -1 if equal and 0 otherwise
+        write_line("", "EQL", node->has_constant() ? constant(node->get_constant()) : operand);
+        write_line("", comparison == Equals ? "AND" : "ADD", s_one, comment);
+        return;
+    }
+
+    write_sign_comparison(comparison, node, operand);
+    write_line("", "AND", s_sign);
+    write_line("", "EQL", s_sign);
+    write_line("", "AND", s_one, comment);
+}
+
+// First pass of write_comparison: folds a constant right operand into the node and asks for its cell
+void GeneratorNodeVisitor::fold_comparison(BinaryExpression *node) {
+    auto value = constant_value(node->get_right().get());
+
+    if (!value) {
+        fold_direct_operand(node);
+        return;
+    }
 
-static std::string s_aux = ".aux";
-static std::string s_one = ".one";
-static std::string s_m_one = ".m_one";
-static std::string s_mask = ".mask";
-static std::string s_sp = ".sp";
-static std::string s_label_prefix = ".L";
+    node->set_constant(*value);
+    node->set_right(nullptr);
 
-std::string GeneratorNodeVisitor::generate(std::shared_ptr<Node> tree) {
-    tree->visit(*this);
-    m_first_pass = false;
-    m_next_label = "";
+    if (is_zero_test(node)) {
+        return;
+    }
 
-    add_identifier(s_aux);
-    add_identifier(s_one);
-    add_identifier(s_m_one);
-    add_identifier(s_mask);
-    add_identifier(s_sp);
+    BinaryOperator comparison = node->is_branch_condition() ? negated_comparison(node->get_operator()) : node->get_operator();
+    int operand = comparison_operand(comparison, *value);
 
-    std::cout << "Declared Identifiers:" << std::endl;
-    for (auto identifier : m_identifiers) {
-        std::cout << identifier << std::endl;
+    if (comparison == Equals || comparison == NotEquals || (operand & 0xFFFFFF) != 0) {
+        constant(operand);
     }
-    std::cout << std::endl;
+}
 
-    for (auto identifier : m_identifiers) {
-        if (identifier.size() > m_max_lpad) {
-            m_max_lpad = identifier.size();
+// Strength reduction: elements indexed by a variable that only changes by constant steps in the loop are addressed
+// through a pointer cell, set up before the loop and stepped along with the variable
+void GeneratorNodeVisitor::reduce_loop_addresses(WhileStatement *node) {
+    LoopScanner scanner;
+    scanner.visit(node->get_bool_expression().get());
+    scanner.visit(node->get_inner().get());
+
+    // Number of steps of each variable assigned in the loop, -1 if it is assigned anything else
+    std::unordered_map<std::string_view, int> steps;
+
+    for (auto assignment : scanner.get_assignments()) {
+        if (assignment->get_element()) {
+            continue;
         }
-    }
 
-    size_t max_label_size = 3 + m_label_count / 10;
-    if (max_label_size > m_max_lpad) {
-        m_max_lpad = max_label_size;
+        int &count = steps[assignment->get_identifier()];
+        if (count >= 0) {
+            count = linear_step(assignment) ? count + 1 : -1;
+        }
     }
 
-    m_max_rpad = m_max_lpad < 8 ? 8 : m_max_lpad;
+    struct PointerCandidate {
+        ArrayPointer pointer;
+        std::vector<IndexExpression *> elements;
+        int saved;
+    };
+    std::vector<PointerCandidate> candidates;
 
-    write_line(s_aux, "DS", "", "second general purpose register");
-    write_line(s_one, "DS", "1", "constant one");
-    write_line(s_m_one, "DS", "-1", "constant minus one");
-    write_line(s_mask, "DS", "0xFFFFFE", "bitmask for use in >>");
-    write_line(s_sp, "DS", "0x10000", "set to high memory");
+    for (auto element : scanner.get_elements()) {
+        std::string_view variable;
+        int offset;
 
-    tree->visit(*this);
+        if (!element->get_index() || !linear_index(element->get_index().get(), variable, offset)) {
+            continue;
+        }
 
-    // TODO: Find syntax to determine HALT
-    write_line("", "HALT", "");
+        auto step = steps.find(variable);
+        if (step == steps.end() || step->second <= 0) {
+            continue;
+        }
 
-    return m_output.str();
-}
+        auto candidate = std::find_if(candidates.begin(), candidates.end(), [&](const PointerCandidate &candidate) {
+            const ArrayPointer &pointer = candidate.pointer;
+            return pointer.array == element->get_identifier() && pointer.variable == variable && pointer.offset == offset;
+        });
 
-void GeneratorNodeVisitor::add_identifier(std::string_view identifier) {
-    if (std::find(m_identifiers.begin(), m_identifiers.end(), identifier) != m_identifiers.end()) {
-        std::cerr << "Multiple declarations of '" << identifier << "' found" << std::endl;
-        exit(-1);
+        if (candidate == candidates.end()) {
+            candidates.push_back({{"", element->get_identifier(), variable, offset}, {}, 0});
+            candidate = candidates.end() - 1;
+        }
+
+        // The address calculation is saved, a store also saves keeping the value aside
+        candidate->elements.push_back(element);
+        candidate->saved += element->is_store() ? 5 : 3;
     }
 
-    m_identifiers.push_back(identifier);
-}
+    std::vector<ArrayPointer> &pointers = m_loop_pointers[node];
 
-void GeneratorNodeVisitor::check_is_declared(std::string_view identifier) {
-    if (std::find(m_identifiers.begin(), m_identifiers.end(), identifier) == m_identifiers.end()) {
-        std::cerr << "No declaration of '" << identifier << "' found" << std::endl;
-        exit(-1);
-    }
-}
+    for (auto &candidate : candidates) {
+        // Each step of the variable costs LDV, ADD and STV on the pointer, for size the setup before the loop counts too
+        int cost = 3 * steps[candidate.pointer.variable];
+        if (m_optimizations.prefer_size) {
+            cost += candidate.pointer.offset != 0 ? 4 : 3;
+        }
 
-std::string GeneratorNodeVisitor::create_label() {
-    static size_t current = 0;
+        if (candidate.saved <= cost) {
+            continue;
+        }
 
-    std::string label;
-    label += s_label_prefix;
-    label += std::to_string(current++);
+        candidate.pointer.name = s_pointer_prefix + std::to_string(m_pointer_index++);
 
-    return label;
-}
+        for (auto element : candidate.elements) {
+            element->set_pointer(candidate.pointer.name);
+            element->set_index(nullptr);
+        }
 
-void GeneratorNodeVisitor::write_padded_identifier(std::string_view identifier) {
-    if (!m_next_label.empty()) {
-        if (!identifier.empty()) {
-            std::cout << "TODO: Multiple labels on line" << std::endl;
+        if (candidate.pointer.offset != 0) {
+            constant(candidate.pointer.offset);
         }
 
-        identifier = m_next_label;
+        pointers.push_back(std::move(candidate.pointer));
     }
 
-    int padding = (int)(m_max_lpad - identifier.size());
+    m_pointer_count = std::max(m_pointer_count, m_pointer_index);
 
-    if (padding) {
-        m_output << std::setw(padding) << " ";
+    for (auto assignment : scanner.get_assignments()) {
+        auto reduced = std::find_if(pointers.begin(), pointers.end(), [assignment](const ArrayPointer &pointer) {
+            return pointer.variable == assignment->get_identifier();
+        });
+
+        if (!assignment->get_element() && reduced != pointers.end()) {
+            m_pointer_steps[assignment] = constant(*linear_step(assignment));
+        }
+    }
+}
+
+bool GeneratorNodeVisitor::use_jump_table(const std::vector<SwitchEntry> &entries) const {
+    if (!m_optimizations.switch_tables || entries.size() < s_min_table_cases) {
+        return false;
     }
 
-    m_output << identifier;
+    long table_size = (long)entries.back().value - entries.front().value + 1;
 
-    if (!m_next_label.empty()) {
-        m_next_label = "";
+    if (m_optimizations.prefer_size) {
+        // The table dispatch takes about 12 words besides the table, the search about 4 per case
+        return 12 + table_size <= 4 * (long)entries.size();
     }
-}
 
-void GeneratorNodeVisitor::write_instruction(std::string instruction) {
-    m_output << " " << std::setw(4) << instruction << " ";
+    return table_size <= s_table_entries_per_case * (long)entries.size();
 }
 
-void GeneratorNodeVisitor::write_hex(int number) {
-    if (number < 0) {
-        number *= -1;
-        number |= (1 << 23);
+// First pass of write_switch_search, the constants and labels it is going to need
+void GeneratorNodeVisitor::register_switch_search(const std::vector<SwitchEntry> &entries, size_t first, size_t last) {
+    if (last - first <= s_linear_cases) {
+        for (size_t index = first; index < last; index++) {
+            if (!fits_ldc(entries[index].value)) {
+                constant(entries[index].value);
+            }
+        }
+        return;
     }
 
-    std::stringstream hex;
-    hex << "0x" << std::hex << number << std::dec;
+    bool by_sign;
+    size_t middle = split_cases(entries, first, last, by_sign);
 
-    m_output << hex.str();
-    m_last_operand_size = hex.str().size();
-}
+    if (!by_sign && entries[middle].value != 0) {
+        constant(-entries[middle].value);
+    }
 
-void GeneratorNodeVisitor::write_number(int number) {
-    std::stringstream num;
-    num << number;
-    m_output << num.str();
-    m_last_operand_size = num.str().size();
+    m_label_count++;
+    register_switch_search(entries, middle, last);
+    register_switch_search(entries, first, middle);
 }
 
-void GeneratorNodeVisitor::write_identifier(std::string_view identifier) {
-    m_output << identifier;
-    m_last_operand_size = identifier.size();
-}
+// Binary search for the value in .aux over the sorted cases [first, last), the last few are compared one by one
+void GeneratorNodeVisitor::write_switch_search(const std::vector<SwitchEntry> &entries, size_t first, size_t last,
+                                               const SwitchLabels &labels, const std::string &otherwise) {
+    if (last - first <= s_linear_cases) {
+        for (size_t index = first; index < last; index++) {
+            int value = entries[index].value;
 
-void GeneratorNodeVisitor::write_comment(const std::string& comment) {
-    if (!comment.empty()) {
-        int padding = (int) (m_max_rpad - m_last_operand_size);
+            if (fits_ldc(value)) {
+                write_line("", "LDC", std::to_string(value));
+                write_line("", "EQL", s_aux);
+            } else {
+                write_line("", "LDV", s_aux);
+                write_line("", "EQL", constant(value));
+            }
 
-        if (padding) {
-            m_output << std::setw(padding) << " ";
+            write_line("", "JMN", labels.cases[entries[index].index], "case " + std::to_string(value));
         }
 
-        m_output << " ;" << comment;
+        write_line("", "JMP", otherwise, "no case matches");
+        return;
     }
-}
 
-void GeneratorNodeVisitor::write_end_line() {
-    m_output << std::endl;
-}
+    bool by_sign;
+    size_t middle = split_cases(entries, first, last, by_sign);
+    int pivot = entries[middle].value;
+    std::string lower = create_label();
 
-void GeneratorNodeVisitor::write_line(std::string_view identifier, std::string instruction, std::string operand, std::string comment)
-{
-    write_padded_identifier(identifier);
-    write_instruction(std::move(instruction));
-    write_identifier(operand);
-    write_comment(comment);
-    write_end_line();
+    write_line("", "LDV", s_aux);
+
+    if (!by_sign && pivot != 0) {
+        write_line("", "ADD", constant(-pivot));
+    }
+
+    write_line("", "JMN", lower, "below case " + std::to_string(pivot));
+    write_switch_search(entries, middle, last, labels, otherwise);
+    set_next_label(lower);
+    write_switch_search(entries, first, middle, labels, otherwise);
 }
 
-void GeneratorNodeVisitor::push() {
-    write_line("", "STIV", s_sp);
-    write_line("", "LDV", s_sp);
-    write_line("", "ADD", s_m_one);
-    write_line("", "STV", s_sp, "push AKKU -> <sp>; sp--");
+// MiMa has no indirect jump, so the value in AKKU is turned into a JMP into the table, which is stored to the
+// cell in front of the table and executed
+void GeneratorNodeVisitor::write_jump_table(const std::vector<SwitchEntry> &entries, const SwitchLabels &labels,
+                                            const std::string &otherwise) {
+    int low = entries.front().value;
+    int high = entries.back().value;
+    std::string in_range = create_label();
+    std::string jump = create_label();
+    std::string table = create_label();
+
+    if (low != 0) {
+        write_line("", "ADD", constant(-low), "index into the jump table");
+    }
+
+    // The index wraps around, so it is in the table if it is at most the last entry when read unsigned
+    write_line("", "JMN", otherwise, "below the first case");
+    write_line("", "STV", s_aux);
+    write_line("", "ADD", constant(low - high - 1));
+    write_line("", "JMN", in_range);
+    write_line("", "JMP", otherwise, "above the last case");
+    set_next_label(in_range);
+    write_line("", "LDC", table);
+    write_line("", "ADD", s_aux);
+    write_line("", "ADD", constant(s_jump_opcode), "opcode of JMP");
+    write_line("", "STV", jump);
+    write_line(jump, "DS", "", "JMP to the entry of the case");
+
+    set_next_label(table);
+
+    auto entry = entries.begin();
+
+    for (long value = low; value <= high; value++) {
+        if (entry->value == value) {
+            write_line("", "JMP", labels.cases[entry->index], "case " + std::to_string(value));
+            entry++;
+        } else {
+            write_line("", "JMP", otherwise);
+        }
+    }
 }
 
-void GeneratorNodeVisitor::pop() {
-    write_line("", "LDV", s_sp);
-    write_line("", "ADD", s_one);
-    write_line("", "STV", s_sp);
-    write_line("", "LDIV", s_sp, "pop <sp + 1> -> AKKU; sp++");
+// Leaves the address of the element in AKKU, the index is in AKKU unless it is addressed directly
+void GeneratorNodeVisitor::write_element_address(IndexExpression *node) {
+    std::string array(node->get_identifier());
+    std::string index = node->get_direct_index();
+
+    if (index.empty()) {
+        write_line("", "STV", s_aux);
+        index = s_aux;
+    }
+
+    write_line("", "LDC", array);
+    write_line("", "ADD", index, "calculate address of " + array + "[]");
 }
 
 void GeneratorNodeVisitor::visit_var_statement(VarStatement *node, int visit_count) {
     if (m_first_pass) {
         add_identifier(node->get_identifier());
+
+        if (node->is_array()) {
+            m_array_sizes[node->get_identifier()] = node->get_array_size();
+        }
         return;
     }
 
+    m_location = node->get_location();
+
+    // Data cells lie in the instruction stream and get executed as well
+    invalidate_accumulator();
+
+    flush_next_label(node->get_identifier());
     write_padded_identifier(node->get_identifier());
     write_instruction("DS");
 
@@ -188,288 +1534,408 @@ void GeneratorNodeVisitor::visit_var_statement(VarStatement *node, int visit_cou
     }
 
     write_end_line();
+    map_location();
+    m_regions.back().second++;
+
+    for (int i = 1; i < node->get_array_size(); i++) {
+        write_line("", "DS", "");
+    }
 }
 
 void GeneratorNodeVisitor::visit_assignment_statement(AssignmentStatement *node, int visit_count) {
     if (m_first_pass) {
-        check_is_declared(node->get_identifier());
+        check_kind(node->get_identifier(), node->get_element() != nullptr);
         return;
     }
 
-    if (visit_count == 1) {
+    m_location = node->get_location();
+
+    // The element stores the value itself
+    if (visit_count == 1 && !node->get_element()) {
         std::string identifier(node->get_identifier());
         std::string comment = identifier;
         comment += " = <expression>";
         write_line("", "STV", identifier, comment);
+
+        auto step = m_pointer_steps.find(node);
+        if (step == m_pointer_steps.end()) {
+            return;
+        }
+
+        for (auto pointers : m_active_pointers) {
+            for (const auto &pointer : *pointers) {
+                if (pointer.variable == node->get_identifier()) {
+                    write_line("", "LDV", pointer.name);
+                    write_line("", "ADD", step->second);
+                    write_line("", "STV", pointer.name, "step pointer along with " + identifier);
+                }
+            }
+        }
     }
 }
 
 void GeneratorNodeVisitor::visit_origin_statement(OriginStatement *node, int visit_count) {
     if (m_first_pass) { return; }
 
+    m_location = node->get_location();
+
+    invalidate_accumulator();
+
+    // A pending label belongs to the first line after the new origin
+    std::string label = std::move(m_next_label);
+    m_next_label.clear();
+
     write_end_line();
     write_padded_identifier("*");
     write_instruction("=");
     write_hex(node->get_number());
     write_end_line();
+
+    m_regions.push_back({node->get_number(), node->get_number()});
+
+    set_next_label(std::move(label));
 }
 
 void GeneratorNodeVisitor::visit_conditional_statement(ConditionalStatement *node, int visit_count) {
-    static std::string labelIf;
-    static std::string labelElse;
-    static std::string labelFinally;
-
     if (m_first_pass) {
         if (visit_count == 0) {
-            m_label_count += node->get_else() ? 3 : 2;
+            m_label_count += node->get_else() ? 2 : 1;
+            mark_branch_condition(node->get_bool_expression().get());
         }
         return;
     }
 
+    m_location = node->get_location();
+
     if (visit_count == 1) {
-        labelIf = create_label();
-        labelElse = create_label();
+        ControlLabels labels;
+        labels.otherwise = create_label();
 
         if (node->get_else()) {
-            labelFinally = create_label();
+            labels.finally = create_label();
         }
 
-        write_line("", "NOT", "", "boolean (0, 1) was AKKU");
-        write_line("", "ADD", s_one);
-        write_line("", "JMN", labelIf, "jump to if block");
-        write_line("", "JMP", labelElse, "jump to else block");
-        m_next_label = labelIf;
+        // AKKU is negative if the condition is false
+        if (!is_branch_condition(node->get_bool_expression().get())) {
+            write_line("", "ADD", s_m_one, "boolean (0, 1) was AKKU");
+        }
+
+        write_line("", "JMN", labels.otherwise, node->get_else() ? "jump to else block" : "jump to statement after if");
+        m_control_labels.push_back(labels);
     } else if (visit_count == 2) {
+        const ControlLabels &labels = m_control_labels.back();
+
         if (node->get_else()) {
-            write_line("", "JMP", labelFinally, "jump to statement after if");
+            write_line("", "JMP", labels.finally, "jump to statement after if");
+        }
+        set_next_label(labels.otherwise);
+
+        if (!node->get_else()) {
+            m_control_labels.pop_back();
         }
-        m_next_label = labelElse;
     } else if (visit_count == 3) {
-        m_next_label = labelFinally;
+        set_next_label(m_control_labels.back().finally);
+        m_control_labels.pop_back();
     }
 }
 
 void GeneratorNodeVisitor::visit_while_statement(WhileStatement *node, int visit_count) {
-    static std::string labelTop;
-    static std::string labelFinally;
-
     if (m_first_pass) {
         if (visit_count == 0) {
             m_label_count += 2;
+            mark_branch_condition(node->get_bool_expression().get());
+
+            if (m_optimizations.loop_pointers) {
+                reduce_loop_addresses(node);
+            }
+        } else if (visit_count == 2) {
+            // Pointers of finished loops are free again
+            m_pointer_index -= m_loop_pointers[node].size();
         }
         return;
     }
 
+    m_location = node->get_location();
+
     if (visit_count == 0) {
-        labelTop = create_label();
-        m_next_label = labelTop;
-    } else if (visit_count == 1) {
-        labelFinally = create_label();
-        write_line("", "ADD", s_m_one, "boolean (0, 1) was AKKU");
-        write_line("", "JMN", labelFinally, "jump to statement after while");
-    } else if (visit_count == 2) {
-        write_line("", "JMP", labelTop, "jump to top of while");
-        m_next_label = labelFinally;
-    }
-}
+        const std::vector<ArrayPointer> &pointers = m_loop_pointers[node];
 
-void GeneratorNodeVisitor::visit_epsilon_statement(EpsilonStatement *node, int visit_count) { }
+        for (const auto &pointer : pointers) {
+            std::string array(pointer.array);
+            write_line("", "LDC", array);
+            write_line("", "ADD", std::string(pointer.variable));
 
-void GeneratorNodeVisitor::visit_number_expression_1(NumberExpression1 *node, int visit_count) {
-    if (m_first_pass) { return; }
+            if (pointer.offset != 0) {
+                write_line("", "ADD", constant(pointer.offset));
+            }
 
-    if (visit_count == 1) {
-        if (node->get_bitwise_and()) {
-            push();
+            write_line("", "STV", pointer.name, "pointer to " + array + "[]");
         }
-    } else if (visit_count == 2) {
-        if (node->get_bitwise_and()) {
-            write_line("", "STV", s_aux);
-            pop();
-            write_line("", "AND", s_aux, "calculate bitwise AND");
+
+        m_active_pointers.push_back(&pointers);
+
+        ControlLabels labels;
+        labels.top = create_label();
+        set_next_label(labels.top);
+        m_control_labels.push_back(labels);
+    } else if (visit_count == 1) {
+        ControlLabels &labels = m_control_labels.back();
+        labels.finally = create_label();
+
+        if (!is_branch_condition(node->get_bool_expression().get())) {
+            write_line("", "ADD", s_m_one, "boolean (0, 1) was AKKU");
         }
+
+        write_line("", "JMN", labels.finally, "jump to statement after while");
+    } else if (visit_count == 2) {
+        const ControlLabels &labels = m_control_labels.back();
+        write_line("", "JMP", labels.top, "jump to top of while");
+        set_next_label(labels.finally);
+        m_control_labels.pop_back();
+        m_active_pointers.pop_back();
     }
 }
 
-void GeneratorNodeVisitor::visit_number_expression_2(NumberExpression2 *node, int visit_count) {
+// The value is compared once by a binary search or, if the cases are dense enough, looked up in a jump table.
+// Each case body ends with a jump past the others.
+void GeneratorNodeVisitor::visit_switch_statement(SwitchStatement *node, int visit_count) {
+    const auto &cases = node->get_cases();
+
     if (m_first_pass) {
         if (visit_count == 0) {
-            m_label_count += 2;
+            auto entries = sorted_cases(node);
+            m_label_count += cases.size() + 1;
+
+            if (entries.empty()) {
+                return;
+            } else if (use_jump_table(entries)) {
+                m_label_count += 3;
+                constant(-entries.front().value);
+                constant(entries.front().value - entries.back().value - 1);
+                constant(s_jump_opcode);
+            } else {
+                register_switch_search(entries, 0, entries.size());
+            }
         }
         return;
     }
 
-    if (visit_count == 1) {
-        if (node->get_bitshift()) {
-            push();
-        }
-    } else if (visit_count == 2) {
-        if (node->get_bitshift()) {
-            std::string labelRepeat = create_label();
-            std::string labelFinally = create_label();
+    m_location = node->get_location();
 
-            if (node->is_left()) {
-                std::cerr << "<< not supported currently" << std::endl;
-                exit(-1);
-            }
+    if (visit_count == 0) {
+        return;
+    } else if (visit_count == 1) {
+        SwitchLabels labels;
 
-            write_line("", "JMN", labelFinally);
-            write_line("", "STV", s_aux, "calculate right shift");
-            write_line(labelRepeat, "LDV", s_aux);
-            write_line("", "ADD", s_m_one);
-            write_line("", "JMN", labelFinally, "count aux to zero");
-            write_line("", "STV", s_aux);
-            pop();
-            write_line("", "AND", s_mask);
-            write_line("", "RAR", "", "shift one bit out");
-            push();
-            m_next_label = labelFinally;
-            pop();
+        for (size_t index = 0; index < cases.size(); index++) {
+            labels.cases.push_back(create_label());
         }
-    }
-}
-
-void GeneratorNodeVisitor::visit_number_expression_3(NumberExpression3 *node, int visit_count) {
-    if (m_first_pass) { return; }
-
-    if (visit_count == 1) {
-        if (node->get_addition()) {
-            push();
+        labels.finally = create_label();
+
+        auto default_case = std::find_if(cases.begin(), cases.end(), [](const SwitchCase &switch_case) {
+            return switch_case.is_default;
+        });
+        const std::string &otherwise = default_case != cases.end() ? labels.cases[default_case - cases.begin()] : labels.finally;
+
+        auto entries = sorted_cases(node);
+
+        if (entries.empty()) {
+            // Only a default case, which runs right away
+        } else if (use_jump_table(entries)) {
+            write_jump_table(entries, labels, otherwise);
+        } else {
+            write_line("", "STV", s_aux, "value to switch on");
+            write_switch_search(entries, 0, entries.size(), labels, otherwise);
         }
-    } else if (visit_count == 2) {
-        if (node->get_addition()) {
-            write_line("", "STV", s_aux);
-            pop();
-            write_line("", "ADD", s_aux, "calculate addition");
+
+        if (cases.empty()) {
+            return;
         }
+
+        set_next_label(labels.cases.front());
+        m_switch_labels.push_back(std::move(labels));
+        return;
     }
-}
 
-void GeneratorNodeVisitor::visit_number_expression_4(NumberExpression4 *node, int visit_count) {
-    if (m_first_pass) { return; }
+    size_t index = visit_count - 2;
+    const SwitchLabels &labels = m_switch_labels.back();
 
-    if (visit_count == 1) {
-        if (node->is_negated()) {
-            write_line("", "NOT", "");
-            write_line("", "ADD", s_one, "calculate negation");
-        }
+    if (index + 1 < cases.size()) {
+        write_line("", "JMP", labels.finally, "jump to statement after switch");
+        set_next_label(labels.cases[index + 1]);
+    } else {
+        set_next_label(labels.finally);
+        m_switch_labels.pop_back();
     }
 }
 
-void GeneratorNodeVisitor::visit_number_expression_5(NumberExpression5 *node, int visit_count) {
-    if (m_first_pass) { return; }
-}
+void GeneratorNodeVisitor::visit_epsilon_statement(EpsilonStatement *node, int visit_count) { }
 
-void GeneratorNodeVisitor::visit_boolean_expression_1(BooleanExpression1 *node, int visit_count)
-{
-    if (m_first_pass) { return; }
+void GeneratorNodeVisitor::visit_binary_expression(BinaryExpression *node, int visit_count) {
+    BinaryOperator op = node->get_operator();
 
-    if (visit_count == 1) {
-        if (node->get_logical_or()) {
-            push();
-        }
-    } else if (visit_count == 2) {
-        if (node->get_logical_or()) {
-            write_line("", "STV", s_aux);
-            pop();
-            write_line("", "OR", s_aux, "calculate boolean OR");
+    if (m_first_pass) {
+        if (visit_count == 0 && is_comparison(op)) {
+            // A constant is only lowered to a sign or zero test on the right
+            if (constant_value(node->get_left().get()) && !constant_value(node->get_right().get())) {
+                std::shared_ptr<Node> left = node->get_left();
+                node->set_left(node->get_right());
+                node->set_right(std::move(left));
+                node->set_operator(mirrored_comparison(op));
+            }
+
+            if (auto mask = operand_mask(node->get_left().get())) {
+                node->set_left_mask(*mask);
+            }
+        } else if (visit_count == 2 && is_comparison(op)) {
+            fold_comparison(node);
+        } else if (visit_count == 2 && (op == Multiplication || op == Division || op == Modulo)) {
+            register_multiplicative(node);
+        } else if (visit_count == 2 && op == ShiftRight) {
+            fold_shift_count(node);
+        } else if (visit_count == 2 && takes_memory_operand(op)) {
+            fold_direct_operand(node);
         }
+        return;
     }
-}
-
-void GeneratorNodeVisitor::visit_boolean_expression_2(BooleanExpression2 *node, int visit_count)
-{
-    if (m_first_pass) { return; }
 
     if (visit_count == 1) {
-        if (node->get_logical_and()) {
+        // A folded constant or direct operand leaves no right node
+        if (node->get_right()) {
             push();
         }
-    } else if (visit_count == 2) {
-        if (node->get_logical_and()) {
-            write_line("", "STV", s_aux);
-            pop();
-            write_line("", "AND", s_aux, "calculate boolean AND");
-        }
+        return;
+    } else if (visit_count != 2) {
+        return;
+    }
+
+    // The right operand is either addressed directly or evaluated into AKKU while the left one waits on the stack
+    std::string operand = node->get_direct_operand();
+
+    if (operand.empty() && !node->has_constant() && takes_memory_operand(op)) {
+        write_line("", "STV", s_aux);
+        pop();
+        operand = s_aux;
+    }
+
+    switch (op) {
+        case BitwiseAnd:
+            write_line("", "AND", operand, "calculate bitwise AND");
+            break;
+        case ShiftRight:
+            if (node->has_constant()) {
+                write_constant_shift_right(node->get_constant());
+            } else {
+                write_shift_right(operand);
+            }
+            break;
+        case Addition:
+            write_line("", "ADD", operand, "calculate addition");
+            break;
+        case Subtraction:
+            write_subtraction(operand, "calculate subtraction");
+            break;
+        case Multiplication:
+        case Division:
+        case Modulo:
+            write_multiplicative(node);
+            break;
+        case LogicalOr:
+            write_line("", "OR", operand, "calculate boolean OR");
+            break;
+        case LogicalAnd:
+            write_line("", "AND", operand, "calculate boolean AND");
+            break;
+        default:
+            write_comparison(node, operand);
+            break;
     }
 }
 
-void GeneratorNodeVisitor::visit_boolean_expression_3(BooleanExpression3 *node, int visit_count)
-{
-    if (m_first_pass) { return; }
+void GeneratorNodeVisitor::visit_unary_expression(UnaryExpression *node, int visit_count) {
+    if (m_first_pass || visit_count != 1) { return; }
 
-    if (visit_count == 1) {
-        if (node->is_negated()) {
-            write_line("", "NOT", "");
-            write_line("", "AND", s_one, "calculate boolean negation");
-        }
+    if (node->get_operator() == Negation) {
+        write_line("", "NOT", "");
+        write_line("", "ADD", s_one, "calculate negation");
+    } else {
+        write_line("", "NOT", "");
+        write_line("", "AND", s_one, "calculate boolean negation");
     }
 }
 
-void GeneratorNodeVisitor::visit_boolean_expression_4(BooleanExpression4 *node, int visit_count)
-{
+void GeneratorNodeVisitor::visit_index_expression(IndexExpression *node, int visit_count) {
     if (m_first_pass) {
         if (visit_count == 0) {
-            if (node->is_comparison() && (node->get_comparison() != Equals && node->get_comparison() != NotEquals)) {
-                m_label_count += 2;
-            }
+            check_kind(node->get_identifier(), true);
+            return;
+        }
+
+        Node *index = node->get_index().get();
+        auto constant_index = constant_value(index);
+
+        if (constant_index && (*constant_index < 0 || *constant_index >= m_array_sizes[node->get_identifier()])) {
+            throw CompileError("Index " + std::to_string(*constant_index) + " out of bounds of '" + std::string(node->get_identifier()) + "'", node->get_identifier());
+        }
+
+        if (auto variable = node_cast<VariableExpression>(index)) {
+            node->set_direct_index(std::string(variable->get_identifier()));
+            node->set_index(nullptr);
+        } else if (constant_index) {
+            std::string array(node->get_identifier());
+            node->set_element(*constant_index ? array + "+" + std::to_string(*constant_index) : array);
+            node->set_index(nullptr);
         }
         return;
     }
 
-    if (visit_count == 1 && node->is_comparison()) {
-        push();
-    } else if (visit_count == 2 && node->is_comparison()) {
-        write_line("", "STV", s_aux);
-        pop();
+    const std::string &element = node->get_element();
+    if (!element.empty()) {
+        if (visit_count == 1) {
+            write_line("", node->is_store() ? "STV" : "LDV", element);
+        }
+        return;
+    }
 
-        // left in akku; right in __aux
+    const std::string &pointer = node->get_pointer();
+    bool direct = !node->get_direct_index().empty();
 
-        std::string label1 = create_label();
-        std::string label2 = create_label();
+    if (visit_count == 0) {
+        // A stored value waits in aux or on the stack while the index is calculated
+        if (node->is_store() && pointer.empty()) {
+            if (direct) {
+                write_line("", "STV", s_aux);
+            } else {
+                push();
+            }
+        }
+        return;
+    }
 
-        Comparison comparison = node->get_comparison();
+    if (!pointer.empty()) {
+        write_line("", node->is_store() ? "STIV" : "LDIV", pointer);
+        return;
+    }
 
-        switch (comparison) {
-            case Equals: // left == __aux
-                write_line("", "EQL", s_aux);
-                write_line("", "NOT", "");
-                write_line("", "ADD", s_one, "calculate boolean ==");
-                break;
-            case NotEquals: // left != __aux
-                write_line("", "EQL", s_aux);
-                write_line("", "ADD", s_one, "calculate boolean !=");
-                break;
-            case LessThan: // left - __aux < 0
-            case GreaterThan: // __aux - left < 0
-            case LessThanOrEqual: // __aux - left >= 0
-            case GreaterThanOrEqual: // left - __aux >= 0
-                write_line("", "NOT", "");
-                write_line("", "ADD", s_one);
-                write_line("", "ADD", s_aux, "calculate right (aux) - left (AKKU)");
-
-                // akku = __aux - left
-
-                if (comparison == LessThan || comparison == GreaterThanOrEqual) {
-                    write_line("", "NOT", "");
-                    write_line("", "ADD", s_one, "calculate left (AKKU) - right (aux)");
-                    // akku = left - __aux
-                }
+    write_element_address(node);
+    write_line("", "STV", s_address);
 
-                write_line("", "JMN", label1);
-                write_line("", "LDC", (comparison == LessThan || comparison == GreaterThan) ? "0" : "1", "result is < 0");
-                write_line("", "JMP", label2);
-                write_line(label1, "LDC", (comparison == LessThan || comparison == GreaterThan) ? "1" : "0", "result is >= 0");
-                m_next_label = label2;
+    if (!node->is_store()) {
+        write_line("", "LDIV", s_address);
+        return;
+    }
 
-                break;
-        }
+    if (direct) {
+        write_line("", "LDV", s_aux);
+    } else {
+        pop();
     }
+    write_line("", "STIV", s_address);
 }
 
 void GeneratorNodeVisitor::visit_variable_expression(VariableExpression *node, int visit_count) {
     if (m_first_pass) {
-        check_is_declared(node->get_identifier());
+        check_kind(node->get_identifier(), false);
         return;
     }
 
@@ -481,21 +1947,18 @@ void GeneratorNodeVisitor::visit_variable_expression(VariableExpression *node, i
 }
 
 void GeneratorNodeVisitor::visit_value_expression(ValueExpression *node, int visit_count) {
-    if (m_first_pass) { return; }
+    if (m_first_pass) {
+        if (!fits_ldc(node->get_number())) {
+            constant(node->get_number());
+        }
+        return;
+    }
 
-    write_padded_identifier("");
-    write_instruction("LDC");
-    write_number(node->get_number());
-    write_comment("constant -> AKKU");
-    write_end_line();
+    write_load_constant(node->get_number(), "constant -> AKKU");
 }
 
 void GeneratorNodeVisitor::visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) {
     if (m_first_pass) { return; }
 
-    write_padded_identifier("");
-    write_instruction("LDC");
-    write_number(node->get_value() ? 1 : 0);
-    write_comment("load boolean true or false");
-    write_end_line();
+    write_line("", "LDC", node->get_value() ? "1" : "0", "load boolean true or false");
 }
\ No newline at end of file
@@ -1,21 +1,109 @@
 #ifndef MIMA_COMPILER_GENERATOR_H
 #define MIMA_COMPILER_GENERATOR_H
 
+#include <deque>
 #include <string>
 #include <sstream>
 #include <memory>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 #include "ast.h"
+#include "passes.h"
 
-class GeneratorNodeVisitor : public NodeVisitor {
+// Star addition chain: values[0] is 1 and values[k] = values[k - 1] + values[addends[k - 1]]
+struct AdditionChain {
+    std::vector<int> values{};
+    std::vector<size_t> addends{};
+};
+
+// Data cell holding a constant, only emitted after the program if it is referenced
+struct PoolConstant {
+    int value;
+    std::string name;
+    std::string operand;
+    std::string comment;
+    bool referenced{false};
+};
+
+// Cell walking over an array in a while loop, it holds the address of array[variable + offset]
+struct ArrayPointer {
+    std::string name;
+    std::string_view array;
+    std::string_view variable;
+    int offset;
+};
+
+// Labels of an enclosing if or while statement that are needed once its body is generated
+struct ControlLabels {
+    std::string top;
+    std::string otherwise;
+    std::string finally;
+};
+
+// Labels of the case bodies of an enclosing switch statement, in the order they are written
+struct SwitchLabels {
+    std::vector<std::string> cases;
+    std::string finally;
+};
+
+// A case value of a switch statement and the index of its case
+struct SwitchEntry {
+    int value;
+    size_t index;
+};
+
+// A word of the program, the index of the region it sits in and the first token of the statement it was generated for
+struct SourceMapping {
+    size_t region;
+    int address;
+    std::string_view location;
+};
+
+// Placement of the runtime stack, both are chosen from the program if unset
+struct StackPlacement {
+    std::optional<int> base{};
+    std::optional<int> size{};
+};
+
+class GeneratorNodeVisitor : public NodeVisitor<GeneratorNodeVisitor> {
 public:
+    explicit GeneratorNodeVisitor(std::ostream *log = nullptr, StackPlacement stack = {}, GeneratorOptimizations optimizations = {})
+        : m_log(log)
+        , m_stack(stack)
+        , m_optimizations(optimizations)
+    { }
+
+    // Assembly with aligned columns and the registers declared in front of the program
     std::string generate(std::shared_ptr<Node> tree);
 
+    // Assembly with tab separated columns and the registers declared after the program, written while generating
+    void generate(std::shared_ptr<Node> tree, std::ostream &output);
+
+    // The same as the streamed generate, but the top-level statements are passed in one at a time as they are parsed
+    // and can be freed afterwards. Declarations have to come before their use either way.
+    void begin(std::ostream &output);
+    void generate_statement(Statement *statement);
+    void end();
+
+    // Records the statement every word of the program is generated for, data cells of declarations included
+    void map_locations() { m_map_locations = true; }
+    // In the order the words are written, final once the program is generated
+    [[nodiscard]] const std::vector<SourceMapping> &get_locations() const { return m_locations; }
+
 private:
+    void declare(Node *tree);
+    void declare_cells();
+    void write_program_end();
+    int write_registers(std::pair<int, int> &region);
+
     void add_identifier(std::string_view identifier);
     void check_is_declared(std::string_view identifier);
-    static std::string create_label();
+    void check_kind(std::string_view identifier, bool array);
+    std::string create_label();
+    void set_next_label(const std::string &label);
+    void flush_next_label(std::string_view label);
 
     void write_padded_identifier(std::string_view identifier);
     void write_instruction(std::string instruction);
@@ -25,37 +113,105 @@ private:
     void write_comment(const std::string& comment);
     void write_end_line();
     void write_line(std::string_view identifier, std::string instruction, std::string operand, std::string comment = "");
+    void map_location();
+
+    bool is_redundant(const std::string &instruction, const std::string &operand) const;
+    void track_accumulator(const std::string &instruction, const std::string &operand);
+    void invalidate_accumulator();
+
+    std::string constant(int value);
+    void mark_referenced(const std::string &operand);
+    void write_load_constant(int value, const std::string &comment);
 
+    void place_stack(std::string &stack_pointer, std::string &comment);
     void push();
     void pop();
 
-    void visit_var_statement(VarStatement *node, int visit_count) override;
-    void visit_assignment_statement(AssignmentStatement *node, int visit_count) override;
-    void visit_origin_statement(OriginStatement *node, int visit_count) override;
-    void visit_conditional_statement(ConditionalStatement *node, int visit_count) override;
-    void visit_while_statement(WhileStatement *node, int visit_count) override;
-    void visit_epsilon_statement(EpsilonStatement *node, int visit_count) override;
-    void visit_number_expression_1(NumberExpression1 *node, int visit_count) override;
-    void visit_number_expression_2(NumberExpression2 *node, int visit_count) override;
-    void visit_number_expression_3(NumberExpression3 *node, int visit_count) override;
-    void visit_number_expression_4(NumberExpression4 *node, int visit_count) override;
-    void visit_number_expression_5(NumberExpression5 *node, int visit_count) override;
-    void visit_boolean_expression_1(BooleanExpression1 *node, int visit_count) override;
-    void visit_boolean_expression_2(BooleanExpression2 *node, int visit_count) override;
-    void visit_boolean_expression_3(BooleanExpression3 *node, int visit_count) override;
-    void visit_boolean_expression_4(BooleanExpression4 *node, int visit_count) override;
-    void visit_variable_expression(VariableExpression *node, int visit_count) override;
-    void visit_value_expression(ValueExpression *node, int visit_count) override;
-    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) override;
+    const AdditionChain &addition_chain(int factor);
+    void fold_direct_operand(BinaryExpression *node);
+    void fold_constant_operand(BinaryExpression *node);
+    void register_multiplicative(BinaryExpression *node);
+    void write_multiplicative(BinaryExpression *node);
+    void write_constant_multiplication(int factor);
+    void write_multiplication();
+    void write_constant_division(int divisor);
+    void write_constant_modulo(int divisor);
+    void fold_shift_count(BinaryExpression *node);
+    void write_constant_shift_right(int count);
+    void write_shift_right(const std::string &count);
+    void write_subtraction(const std::string &operand, const std::string &comment);
+    void write_reverse_subtraction(const std::string &operand, const std::string &comment);
+    void write_sign_comparison(BinaryOperator comparison, BinaryExpression *node, const std::string &operand);
+    void write_comparison(BinaryExpression *node, const std::string &operand);
+    void fold_comparison(BinaryExpression *node);
+    void reduce_loop_addresses(WhileStatement *node);
+    bool use_jump_table(const std::vector<SwitchEntry> &entries) const;
+    void register_switch_search(const std::vector<SwitchEntry> &entries, size_t first, size_t last);
+    void write_switch_search(const std::vector<SwitchEntry> &entries, size_t first, size_t last, const SwitchLabels &labels, const std::string &otherwise);
+    void write_jump_table(const std::vector<SwitchEntry> &entries, const SwitchLabels &labels, const std::string &otherwise);
+    void write_element_address(IndexExpression *node);
+
+    friend class NodeVisitor<GeneratorNodeVisitor>;
+
+    void visit_var_statement(VarStatement *node, int visit_count);
+    void visit_assignment_statement(AssignmentStatement *node, int visit_count);
+    void visit_origin_statement(OriginStatement *node, int visit_count);
+    void visit_conditional_statement(ConditionalStatement *node, int visit_count);
+    void visit_while_statement(WhileStatement *node, int visit_count);
+    void visit_switch_statement(SwitchStatement *node, int visit_count);
+    void visit_epsilon_statement(EpsilonStatement *node, int visit_count);
+    void visit_binary_expression(BinaryExpression *node, int visit_count);
+    void visit_unary_expression(UnaryExpression *node, int visit_count);
+    void visit_index_expression(IndexExpression *node, int visit_count);
+    void visit_variable_expression(VariableExpression *node, int visit_count);
+    void visit_value_expression(ValueExpression *node, int visit_count);
+    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count);
 
     std::vector<std::string_view> m_identifiers{};
     size_t m_max_lpad{0};
     size_t m_max_rpad{0};
     size_t m_last_operand_size{0};
     size_t m_label_count{0};
-    std::stringstream m_output{};
+    size_t m_label_index{0};
+    std::vector<ControlLabels> m_control_labels{};
+    std::vector<SwitchLabels> m_switch_labels{};
+    size_t m_temp_count{0};
+    // Deques keep the names in place, m_identifiers refers to them
+    std::deque<std::string> m_temporaries{};
+    std::unordered_map<int, AdditionChain> m_addition_chains{};
+    std::vector<PoolConstant> m_constants{};
+    std::unordered_map<std::string_view, int> m_array_sizes{};
+    // Pointers set up before each loop, the constant every reduced step assignment adds to them
+    // and the pointers of the loops around the code being generated
+    std::unordered_map<const WhileStatement *, std::vector<ArrayPointer>> m_loop_pointers{};
+    std::unordered_map<const AssignmentStatement *, std::string> m_pointer_steps{};
+    std::vector<const std::vector<ArrayPointer> *> m_active_pointers{};
+    size_t m_pointer_count{0};
+    size_t m_pointer_index{0};
+    std::deque<std::string> m_pointers{};
+    std::ostream *m_output{nullptr};
+    bool m_streamed{false};
     bool m_first_pass{true};
     std::string m_next_label;
+    std::ostream *m_log;
+    StackPlacement m_stack;
+    GeneratorOptimizations m_optimizations;
+    size_t m_stack_depth{0};
+    size_t m_max_stack_depth{0};
+    // Statement that first pushed as deep as the stack gets, errors about the stack point at it
+    std::string_view m_deepest_push{};
+    // Address ranges [first, second) the program occupies, a new one starts at every origin
+    std::vector<std::pair<int, int>> m_regions{};
+    // Statement the code being generated belongs to and the words written for each statement so far
+    std::string_view m_location{};
+    bool m_map_locations{false};
+    std::vector<SourceMapping> m_locations{};
+
+    // Cells whose memory currently equals AKKU, address cells whose element does and the LDC operand AKKU was
+    // loaded with, if any. Only valid across straight-line code, so all are reset whenever a label is placed.
+    std::vector<std::string> m_akku_cells{};
+    std::vector<std::string> m_akku_addresses{};
+    std::string m_akku_constant{};
 };
 
 #endif //MIMA_COMPILER_GENERATOR_H
@@ -1,94 +1,340 @@
 #include "lexer.h"
 
-#include <regex>
+#include <algorithm>
+#include <charconv>
+#include <exception>
 #include <iostream>
+#include <thread>
 #include <utility>
 
-static const std::regex s_regex_keyword(R"(^(var|org|if|else|true|false|while))");
-static const std::regex s_regex_identifier(R"(^([a-zA-Z_][a-zA-Z0-9_\-]*))");
-static const std::regex s_regex_number(R"(^(\d(?!x|b)\d*))");
-static const std::regex s_regex_hex(R"(^(0x[0-9a-fA-F]+))");
-static const std::regex s_regex_bin(R"(^(0b[01]+))");
-static const std::regex s_regex_special(R"(^(==|<=|>=|!=|>>|[=\-+[\](){}<>&|;,]))");
-static const std::regex s_regex_space(R"(^(\s+))");
-static const std::regex s_regex_comment(R"(^(//.*\n|//.*$))");
+#include "error.h"
+#include "scanner.h"
 
-Tokenization::Tokenization(std::string file_content)
-{
-    m_file_content = std::move(file_content);
+// Bytes lexed into one batch for the parser when compiling pipelined
+static const size_t s_batch_size = 1 << 16;
+
+// Inputs are only split into chunks of at least this size, smaller ones are not worth a thread
+static const size_t s_min_chunk_size = 1 << 20;
+
+// Literals are words of the 24 bit MiMa, negative numbers are written with a unary minus
+static const int s_max_literal = 0xFFFFFF;
+
+struct KeywordEntry {
+    std::string_view string;
+    TokenKind kind;
+};
+
+// Perfect hash of the keywords: the first character plus 7 times the length modulo 16 differs for each of them
+static const KeywordEntry s_keywords[16] = {
+    {"true", TokenKind::True},
+    {"else", TokenKind::Else},
+    {},
+    {},
+    {"org", TokenKind::Org},
+    {"default", TokenKind::Default},
+    {},
+    {"if", TokenKind::If},
+    {},
+    {"false", TokenKind::False},
+    {"while", TokenKind::While},
+    {"var", TokenKind::Var},
+    {},
+    {"switch", TokenKind::Switch},
+    {},
+    {"case", TokenKind::Case},
+};
+
+static TokenKind keyword_kind(std::string_view identifier) {
+    const auto &keyword = s_keywords[(identifier.front() + 7 * identifier.size()) & 15];
+    return keyword.string == identifier ? keyword.kind : TokenKind::None;
+}
+
+static TokenKind operator_kind(std::string_view symbol) {
+    char second = symbol.size() > 1 ? symbol[1] : '\0';
+
+    switch (symbol[0]) {
+        case '=': return second == '=' ? TokenKind::Equal : TokenKind::Assign;
+        case '!': return second == '=' ? TokenKind::NotEqual : TokenKind::LogicalNot;
+        case '<': return second == '=' ? TokenKind::LessEqual : TokenKind::Less;
+        case '>': return second == '=' ? TokenKind::GreaterEqual : second == '>' ? TokenKind::ShiftRight : TokenKind::Greater;
+        case '&': return second == '&' ? TokenKind::LogicalAnd : TokenKind::Ampersand;
+        case '|': return second == '|' ? TokenKind::LogicalOr : TokenKind::Pipe;
+        case '+': return TokenKind::Plus;
+        case '-': return TokenKind::Minus;
+        case '*': return TokenKind::Star;
+        case '/': return TokenKind::Slash;
+        case '%': return TokenKind::Percent;
+        case '(': return TokenKind::LeftParenthesis;
+        case ')': return TokenKind::RightParenthesis;
+        case '[': return TokenKind::LeftBracket;
+        case ']': return TokenKind::RightBracket;
+        case '{': return TokenKind::LeftBrace;
+        case '}': return TokenKind::RightBrace;
+        case ';': return TokenKind::Semicolon;
+        case ':': return TokenKind::Colon;
+        case ',': return TokenKind::Comma;
+        default: return TokenKind::None;
+    }
+}
+
+static bool is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_hex_digit(char c) {
+    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Value of a literal whose digits follow a prefix of the given length
+static int parse_number(std::string_view literal, size_t prefix, int base) {
+    auto digits = literal.substr(prefix);
+    int value = 0;
+    auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value, base);
+
+    if (error != std::errc() || end != digits.data() + digits.size() || value > s_max_literal) {
+        throw CompileError("Number out of range", literal);
+    }
 
-    std::cout << "Input:" << std::endl;
-    std::cout << m_file_content << std::endl << std::endl;
+    return value;
+}
 
-    m_index = 0;
-    m_tokens = std::vector<Token>();
+// Length of an operator, two character ones take precedence
+static size_t operator_length(std::string_view rest) {
+    static const std::string_view s_pairs[] = {"==", "<=", ">=", "!=", ">>", "&&", "||"};
+    static const std::string_view s_singles = "=-+*/%[](){}<>&|!;:,";
 
-    std::cout << "Matches:" << std::endl;
+    for (auto pair : s_pairs) {
+        if (rest.starts_with(pair)) {
+            return 2;
+        }
+    }
+
+    return s_singles.find(rest.front()) != std::string_view::npos ? 1 : 0;
+}
 
-    long position = 0;
+// Lexes the tokens starting in [position, end) of the content; a token may look past end, so a chunk lexes
+// exactly like the same lines of the whole input.
+// Runs of spaces, identifier characters, digits and comments are found with scan_run.
+static void lex(std::string_view content, size_t position, size_t end, TokenColumns &tokens, std::ostream *log) {
+    const char *begin = content.data();
+    const char *content_end = begin + content.size();
 
-    while (position < m_file_content.length()) {
-        std::smatch match;
+    while (position < end) {
+        const char *current = begin + position;
+        std::string_view rest = content.substr(position);
         TokenType type;
+        TokenKind token_kind = TokenKind::None;
+        const char *kind;
+        size_t length;
         int value = 0;
 
-        if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match, s_regex_comment)) {
-            std::cout << "Comment " << match.str();
-            position += match.length();
+        if (rest.starts_with("//")) {
+            // A comment ends after its line break, a carriage return before it is no comment body
+            length = 2 + scan_run(CharacterClass::CommentBody, current + 2, content_end);
+            if (length == rest.size() || rest[length] == '\n') {
+                length += length < rest.size();
+
+                if (log) {
+                    *log << "Comment " << rest.substr(0, length);
+                }
+                position += length;
+                continue;
+            }
+        }
+
+        char first = rest.front();
+        char second = rest.size() > 1 ? rest[1] : '\0';
+
+        if ((length = scan_run(CharacterClass::Space, current, content_end))) {
+            position += length;
             continue;
-        } else if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match, s_regex_space)) {
-            std::cout << "Space";
-            type = Space;
-        } else if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match, s_regex_keyword)) {
-            std::cout << "Keyword";
-            type = Keyword;
-        } else if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match,s_regex_identifier)) {
-            std::cout << "Identifier";
-            type = Identifier;
-        } else if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match,s_regex_number)) {
-            std::cout << "Number";
+        } else if (is_letter(first) || first == '_') {
+            length = 1 + scan_run(CharacterClass::IdentifierBody, current + 1, content_end);
+            token_kind = keyword_kind(rest.substr(0, length));
+            type = token_kind == TokenKind::None ? Identifier : Keyword;
+            kind = token_kind == TokenKind::None ? "Identifier" : "Keyword";
+        } else if (is_digit(first) && second != 'x' && second != 'b') {
+            length = 1 + scan_run(CharacterClass::Digit, current + 1, content_end);
             type = Value;
-            value = std::stoi(match.str(), nullptr, 10);
-        } else if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match,s_regex_hex)) {
-            std::cout << "Hex";
+            kind = "Number";
+            value = parse_number(rest.substr(0, length), 0, 10);
+        } else if (first == '0' && second == 'x' && rest.size() > 2 && is_hex_digit(rest[2])) {
+            length = 3;
+            while (length < rest.size() && is_hex_digit(rest[length])) {
+                length++;
+            }
             type = Value;
-            value = std::stoi(match.str(), nullptr, 16);
-        } else if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match,s_regex_bin)) {
-            std::cout << "Bin";
+            kind = "Hex";
+            value = parse_number(rest.substr(0, length), 2, 16);
+        } else if (first == '0' && second == 'b' && rest.size() > 2 && (rest[2] == '0' || rest[2] == '1')) {
+            length = 3;
+            while (length < rest.size() && (rest[length] == '0' || rest[length] == '1')) {
+                length++;
+            }
             type = Value;
-            value = std::stoi(match.str(), nullptr, 2);
-        } else if (std::regex_search(m_file_content.cbegin() + position, m_file_content.cend(), match,s_regex_special)) {
-            std::cout << "Special";
+            kind = "Bin";
+            value = parse_number(rest.substr(0, length), 2, 2);
+        } else if ((length = operator_length(rest))) {
+            token_kind = operator_kind(rest.substr(0, length));
             type = SpecialSymbol;
+            kind = "Special";
         } else {
-            std::cerr << "Invalid token '" << m_file_content.at(position) << "' found" << std::endl;
-            exit(-1);
+            throw CompileError(std::string("Invalid token '") + first + "' found", content.substr(position, 1));
+        }
+
+        if (log) {
+            *log << kind << " '" << rest.substr(0, length) << "' at " << position << std::endl;
         }
 
-        std::cout << " '" << (type == Space ? " " : match.str()) << "' at " << position << std::endl;
+        tokens.push(type, token_kind, position, length, value);
 
-        Token token;
-        token.type = type;
-        token.string = std::string_view(m_file_content.cbegin() + position, m_file_content.cbegin() + position + match.length());
-        token.number = value;
+        position += length;
+    }
+}
+
+Tokenization::Tokenization(std::string_view file_content, std::ostream *log)
+{
+    m_file_content = file_content;
+
+    if (log) {
+        *log << "Input:" << std::endl;
+        *log << m_file_content << std::endl << std::endl;
+    }
 
-        m_tokens.push_back(token);
+    size_t chunk_count = std::min<size_t>(std::thread::hardware_concurrency(), m_file_content.size() / s_min_chunk_size);
 
-        position += match.length();
+    // The log lists the matches in order, so it is always written by one thread
+    if (!log && chunk_count > 1) {
+        lex_chunks(chunk_count);
+        return;
     }
 
-    std::cout << std::endl;
+    m_tokens.reserve(m_file_content.size() / 4 + 16);
+
+    if (log) {
+        *log << "Matches:" << std::endl;
+    }
+
+    lex(m_file_content, 0, m_file_content.size(), m_tokens, log);
+
+    if (log) {
+        *log << std::endl;
+    }
 }
 
-Token Tokenization::peek(int next) const
+Tokenization::Tokenization(std::string_view file_content, TokenQueue &batches)
+    : m_file_content(file_content)
+    , m_batches(&batches)
 {
-    if (m_index + next >= m_tokens.size()) {
+    m_tokens = m_batches->pop().value_or(TokenColumns{});
+}
+
+void Tokenization::lex_batches(std::string_view file_content, TokenQueue &batches) {
+    size_t position = 0;
+
+    while (position < file_content.size()) {
+        size_t end = file_content.find('\n', std::min(position + s_batch_size, file_content.size()));
+        end = end == std::string_view::npos ? file_content.size() : end + 1;
+
+        TokenColumns batch;
+        lex(file_content, position, end, batch, nullptr);
+        position = end;
+
+        if (!batch.types.empty() && !batches.push(std::move(batch))) {
+            return;
+        }
+    }
+}
+
+void Tokenization::lex_chunks(size_t chunk_count) {
+    // Chunks end after a line break, or at the end of the input
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < chunk_count; i++) {
+        size_t bound = m_file_content.find('\n', std::max(bounds.back(), i * m_file_content.size() / chunk_count));
+        if (bound == std::string_view::npos) {
+            break;
+        }
+        bounds.push_back(bound + 1);
+    }
+    bounds.push_back(m_file_content.size());
+
+    std::vector<TokenColumns> chunks(bounds.size() - 1);
+    std::vector<std::exception_ptr> errors(chunks.size());
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        threads.emplace_back([&, i] {
+            try {
+                chunks[i].reserve((bounds[i + 1] - bounds[i]) / 4 + 16);
+                lex(m_file_content, bounds[i], bounds[i + 1], chunks[i], nullptr);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // The first error in the input is the one lexing it in one piece would have stopped at
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    size_t count = 0;
+    for (const auto &chunk : chunks) {
+        count += chunk.types.size();
+    }
+
+    m_tokens.reserve(count);
+    for (const auto &chunk : chunks) {
+        m_tokens.append(chunk);
+    }
+}
+
+void TokenColumns::reserve(size_t count) {
+    types.reserve(count);
+    kinds.reserve(count);
+    offsets.reserve(count);
+    lengths.reserve(count);
+    values.reserve(count);
+}
+
+void TokenColumns::push(TokenType type, TokenKind kind, size_t offset, size_t length, int value) {
+    types.push_back(type);
+    kinds.push_back(kind);
+    offsets.push_back(offset);
+    lengths.push_back(length);
+    values.push_back(value);
+}
+
+void TokenColumns::append(const TokenColumns &other) {
+    types.insert(types.end(), other.types.begin(), other.types.end());
+    kinds.insert(kinds.end(), other.kinds.begin(), other.kinds.end());
+    offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+    lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+    values.insert(values.end(), other.values.begin(), other.values.end());
+}
+
+Token Tokenization::peek() const
+{
+    size_t index = m_index;
+
+    if (index >= m_tokens.kinds.size()) {
         Token token;
         token.type = Invalid;
         return token;
     }
 
-    return m_tokens[m_index + next];
+    return {m_tokens.types[index], m_tokens.kinds[index], m_file_content.substr(m_tokens.offsets[index], m_tokens.lengths[index]),
+            m_tokens.values[index]};
 }
 
 void Tokenization::next()
@@ -96,9 +342,15 @@ void Tokenization::next()
     if (hasNext()) {
         m_index++;
     }
+
+    // Batches are never empty, so the next token is always in the current one
+    if (m_batches && m_index == m_tokens.kinds.size()) {
+        m_tokens = m_batches->pop().value_or(TokenColumns{});
+        m_index = 0;
+    }
 }
 
 bool Tokenization::hasNext() const
 {
-    return m_index != m_tokens.size() - 1;
-}
\ No newline at end of file
+    return m_index < m_tokens.kinds.size();
+}
@@ -1,37 +1,113 @@
 #ifndef MIMA_COMPILER_LEXER_H
 #define MIMA_COMPILER_LEXER_H
 
+#include <cstdint>
+#include <ostream>
 #include <vector>
 #include <string>
 #include <string_view>
 
-enum TokenType {
+#include "bounded_queue.h"
+
+enum TokenType : uint8_t {
     Invalid,
     Keyword,
     Identifier,
     Value,
     SpecialSymbol,
-    Space,
+};
+
+// Keywords and operators are classified by the lexer, so the parser compares integers instead of strings
+enum class TokenKind : uint8_t {
+    None,
+
+    Var,
+    Org,
+    If,
+    Else,
+    True,
+    False,
+    While,
+    Switch,
+    Case,
+    Default,
+
+    Assign,
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+    ShiftRight,
+    Plus,
+    Minus,
+    Star,
+    Slash,
+    Percent,
+    Ampersand,
+    Pipe,
+    LogicalAnd,
+    LogicalOr,
+    LogicalNot,
+    LeftParenthesis,
+    RightParenthesis,
+    LeftBracket,
+    RightBracket,
+    LeftBrace,
+    RightBrace,
+    Semicolon,
+    Colon,
+    Comma,
 };
 
 struct Token {
     TokenType type;
+    TokenKind kind{TokenKind::None};
     std::string_view string;
     int number;
 };
 
+// Tokens as parallel arrays, offsets are relative to the whole file content
+struct TokenColumns {
+    std::vector<TokenType> types;
+    std::vector<TokenKind> kinds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<int> values;
+
+    void reserve(size_t count);
+    void push(TokenType type, TokenKind kind, size_t offset, size_t length, int value);
+    void append(const TokenColumns &other);
+};
+
+// Batches of tokens passed from the lexer thread to the parser when compiling pipelined
+using TokenQueue = BoundedQueue<TokenColumns>;
+
+// Tokens and the AST built from them refer into the file content, which has to outlive both.
+// Whitespace and comments are dropped, the tokens are stored as parallel arrays and peek() assembles a Token from them.
+// Large inputs are split at line breaks, as no token or comment spans one, and the chunks are lexed concurrently.
 class Tokenization {
 public:
-    explicit Tokenization(std::string file_content);
+    explicit Tokenization(std::string_view file_content, std::ostream *log = nullptr);
 
-    Token peek(int next = 0) const;
+    // Takes the tokens batch by batch from a queue filled by lex_batches on another thread
+    Tokenization(std::string_view file_content, TokenQueue &batches);
+
+    // Lexes the content into batches of a few lines each, until done or the queue is closed
+    static void lex_batches(std::string_view file_content, TokenQueue &batches);
+
+    Token peek() const;
     void next();
     bool hasNext() const;
 
 private:
-    std::vector<Token> m_tokens;
-    size_t m_index;
-    std::string m_file_content;
+    void lex_chunks(size_t chunk_count);
+
+    TokenColumns m_tokens;
+    size_t m_index{0};
+    std::string_view m_file_content;
+    TokenQueue *m_batches{nullptr};
 };
 
 
@@ -1,35 +1,377 @@
 #include <iostream>
 
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
 
-#include "lexer.h"
-#include "parser.h"
-#include "generator.h"
+#include <unistd.h>
 
-int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input> <output>" << std::endl;
-        exit(-1);
+#include "allocations.h"
+#include "cache.h"
+#include "error.h"
+#include "mima.h"
+#include "server.h"
+#include "thread_pool.h"
+
+// Highest address of the 20 bit address space
+static const std::uintmax_t s_max_address = 0xFFFFF;
+
+struct Job {
+    std::string input;
+    std::string output;
+};
+
+static void usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <input> <output>" << std::endl;
+    std::cerr << "       " << program << " [options] --batch <input>..." << std::endl;
+    std::cerr << "       " << program << " [options] --manifest <file>" << std::endl;
+    std::cerr << "       " << program << " [options] --serve [--socket <path>]" << std::endl;
+    std::cerr << "Options: --cache-dir <directory> --cache-size <bytes> -j <threads>" << std::endl;
+    std::cerr << "         --stack-base <address> --stack-size <cells>" << std::endl;
+    std::cerr << "         -O0 | -O1 | -O2 | -Os --pass-stats --mem-report --stream --pipeline --source-map --verbose" << std::endl;
+    exit(-1);
+}
+
+// Parses a decimal or 0x prefixed option value within [minimum, maximum], anything else is a usage error
+static std::uintmax_t parse_number(const char *program, std::string_view option, std::string_view text,
+                                   std::uintmax_t minimum, std::uintmax_t maximum) {
+    int base = 10;
+    if (text.starts_with("0x") || text.starts_with("0X")) {
+        text.remove_prefix(2);
+        base = 16;
+    }
+
+    std::uintmax_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+
+    if (text.empty() || error != std::errc() || end != text.data() + text.size() || value < minimum || value > maximum) {
+        std::cerr << option << ": Expected a number from " << minimum;
+        if (maximum != UINTMAX_MAX) {
+            std::cerr << " to " << maximum;
+        }
+        std::cerr << std::endl;
+        usage(program);
+    }
+
+    return value;
+}
+
+// Formats the diagnostics as "<input>:<line>:<column>: <message>" lines
+static std::string format_diagnostics(const Job &job, const std::vector<mima::Diagnostic> &diagnostics) {
+    std::string message;
+
+    for (const auto &diagnostic : diagnostics) {
+        if (!message.empty()) {
+            message += '\n';
+        }
+
+        message += job.input;
+        if (diagnostic.line) {
+            message += ":" + std::to_string(diagnostic.line) + ":" + std::to_string(diagnostic.column);
+        }
+        message += ": " + diagnostic.message;
+    }
+
+    return message;
+}
+
+// Writes one "<address> <input>:<line>:<column>" line per word of the program to "<output>.map", which MIMA_Profiler reads
+static void write_source_map(const Job &job, const std::vector<mima::SourceLocation> &locations) {
+    std::string path = job.output + ".map";
+    std::ofstream stream(path, std::ios::trunc);
+
+    for (const auto &location : locations) {
+        stream << "0x" << std::hex << std::uppercase << std::setw(6) << std::setfill('0') << location.address << std::dec
+               << ' ' << job.input << ':' << location.line << ':' << location.column << '\n';
+    }
+
+    stream.flush();
+
+    if (!stream) {
+        throw CompileError(path + ": Could not write file");
+    }
+}
+
+// Compiles a single job, consulting the cache first. Throws CompileError on invalid input.
+static void compile_job(const Job &job, CompileCache *cache, const std::string &options, const mima::Options &compile_options) {
+    std::ifstream file_stream(job.input);
+    if (!file_stream) {
+        throw CompileError(job.input + ": Could not read file");
     }
 
-    std::ifstream file_stream(argv[1]);
     std::string file_content((std::istreambuf_iterator<char>(file_stream)), std::istreambuf_iterator<char>());
 
-    Tokenization tokenization = Tokenization(file_content);
-    ParserNodeVisitor visitor(tokenization);
-    auto tree = visitor.parse();
+    // A streamed program is never held in memory, so it is neither cached nor logged
+    if (compile_options.format == mima::OutputFormat::Streamed) {
+        std::ofstream output_stream(job.output, std::ios::trunc);
+        auto result = mima::compile(file_content, output_stream, compile_options);
+        output_stream.close();
+
+        if (!result.success) {
+            std::filesystem::remove(job.output);
+            throw CompileError(format_diagnostics(job, result.diagnostics));
+        }
+
+        if (!output_stream) {
+            throw CompileError(job.output + ": Could not write file");
+        }
+
+        if (compile_options.source_map) {
+            write_source_map(job, result.source_map);
+        }
+
+        return;
+    }
+
+    std::string output;
 
-    GeneratorNodeVisitor generator;
-    std::string output = generator.generate(tree);
+    // The source map is not cached, so it takes a compilation
+    if (cache && !compile_options.source_map) {
+        if (auto cached = cache->load(file_content, options)) {
+            output = std::move(*cached);
+        }
+    }
+
+    if (output.empty()) {
+        auto result = mima::compile(file_content, compile_options);
+        if (!result.success) {
+            throw CompileError(format_diagnostics(job, result.diagnostics));
+        }
+
+        output = std::move(result.assembly);
 
-    std::cout << "Compiled file:" << std::endl;
-    std::cout << output << std::endl;
+        if (cache) {
+            cache->store(file_content, options, output);
+        }
 
-    std::ofstream output_stream(argv[2], std::ios::trunc);
+        if (compile_options.source_map) {
+            write_source_map(job, result.source_map);
+        }
+    }
+
+    if (compile_options.log) {
+        *compile_options.log << "Compiled file:" << std::endl;
+        *compile_options.log << output << std::endl;
+    }
+
+    std::ofstream output_stream(job.output, std::ios::trunc);
     output_stream << output;
     output_stream.flush();
-    output_stream.close();
 
-    return 0;
+    if (!output_stream) {
+        throw CompileError(job.output + ": Could not write file");
+    }
+}
+
+static std::vector<Job> read_manifest(const char *path) {
+    std::ifstream stream(path);
+    if (!stream) {
+        std::cerr << "Could not read manifest '" << path << "'" << std::endl;
+        exit(-1);
+    }
+
+    // One "<input> [<output>]" pair per line, empty lines and lines starting with # are skipped
+    std::vector<Job> jobs;
+    std::string line;
+
+    while (std::getline(stream, line)) {
+        std::istringstream fields(line);
+        Job job;
+
+        if (!(fields >> job.input) || job.input.starts_with("#")) {
+            continue;
+        }
+
+        if (!(fields >> job.output)) {
+            job.output = std::filesystem::path(job.input).replace_extension(".asm").string();
+        }
+
+        jobs.push_back(job);
+    }
+
+    return jobs;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<const char *> positional;
+    const char *manifest = nullptr;
+    const char *cache_directory = nullptr;
+    std::uintmax_t cache_size = 64 * 1024 * 1024;
+    const char *socket_path = nullptr;
+    size_t threads = std::thread::hardware_concurrency();
+    bool batch = false;
+    bool memory_report = false;
+    bool serve = false;
+    bool verbose = false;
+    mima::Options compile_options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view argument(argv[i]);
+
+        if (argument == "--cache-dir" && i + 1 < argc) {
+            cache_directory = argv[++i];
+        } else if (argument == "--cache-size" && i + 1 < argc) {
+            cache_size = parse_number(argv[0], argument, argv[++i], 0, UINTMAX_MAX);
+        } else if (argument == "--batch") {
+            batch = true;
+        } else if (argument == "--manifest" && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (argument == "--serve") {
+            serve = true;
+        } else if (argument == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (argument == "-j" && i + 1 < argc) {
+            threads = parse_number(argv[0], argument, argv[++i], 1, 1024);
+        } else if (argument == "--stack-base" && i + 1 < argc) {
+            compile_options.stack_base = (int)parse_number(argv[0], argument, argv[++i], 0, s_max_address);
+        } else if (argument == "--stack-size" && i + 1 < argc) {
+            compile_options.stack_size = (int)parse_number(argv[0], argument, argv[++i], 0, s_max_address + 1);
+        } else if (argument == "-O0") {
+            compile_options.optimization = mima::OptimizationLevel::O0;
+        } else if (argument == "-O1") {
+            compile_options.optimization = mima::OptimizationLevel::O1;
+        } else if (argument == "-O2") {
+            compile_options.optimization = mima::OptimizationLevel::O2;
+        } else if (argument == "-Os") {
+            compile_options.optimization = mima::OptimizationLevel::Os;
+        } else if (argument == "--stream") {
+            compile_options.format = mima::OutputFormat::Streamed;
+        } else if (argument == "--pipeline") {
+            compile_options.format = mima::OutputFormat::Streamed;
+            compile_options.pipelined = true;
+        } else if (argument == "--mem-report") {
+#ifndef MIMA_ALLOCATION_TRACKING
+            std::cerr << "--mem-report: Configure with -DMIMA_ALLOCATION_TRACKING=ON to count allocations" << std::endl;
+            exit(-1);
+#endif
+            memory_report = true;
+        } else if (argument == "--source-map") {
+            compile_options.source_map = true;
+        } else if (argument == "--verbose") {
+            verbose = true;
+        } else if (argument == "--pass-stats") {
+            compile_options.statistics = &std::cerr;
+        } else if (argument.starts_with("-")) {
+            usage(argv[0]);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (memory_report) {
+        enable_allocation_tracking();
+    }
+
+    if (serve) {
+        CompileServer server(compile_options, threads);
+
+        if (!socket_path) {
+            server.serve(STDIN_FILENO, STDOUT_FILENO);
+            return 0;
+        }
+
+        try {
+            server.listen(socket_path);
+        } catch (const std::system_error &error) {
+            std::cerr << error.what() << std::endl;
+            exit(-1);
+        }
+    }
+
+    std::vector<Job> jobs;
+
+    if (manifest) {
+        jobs = read_manifest(manifest);
+    } else if (batch) {
+        for (const char *input : positional) {
+            jobs.push_back({input, std::filesystem::path(input).replace_extension(".asm").string()});
+        }
+    } else if (positional.size() == 2) {
+        jobs.push_back({positional[0], positional[1]});
+    } else {
+        usage(argv[0]);
+    }
+
+    // Options that change the generated output, part of the cache key
+    std::string options;
+
+    if (compile_options.stack_base) {
+        options += "stack-base=" + std::to_string(*compile_options.stack_base) + "\n";
+    }
+
+    if (compile_options.stack_size) {
+        options += "stack-size=" + std::to_string(*compile_options.stack_size) + "\n";
+    }
+
+    options += "optimization=" + std::to_string(static_cast<int>(compile_options.optimization)) + "\n";
+
+    std::unique_ptr<CompileCache> cache;
+    if (cache_directory) {
+        cache = std::make_unique<CompileCache>(cache_directory, cache_size);
+    }
+
+    if (!manifest && !batch) {
+        try {
+            // The dump is written while compiling, so it also turns off the threads of --pipeline and the chunked lexer
+            mima::Options logged_options = compile_options;
+            logged_options.log = verbose ? &std::cout : nullptr;
+            compile_job(jobs.front(), cache.get(), options, logged_options);
+        } catch (const CompileError &error) {
+            std::cerr << error.what() << std::endl;
+            exit(-1);
+        }
+
+        if (memory_report) {
+            report_allocations(std::cerr);
+        }
+
+        return 0;
+    }
+
+    // Written concurrently by the workers, one element each
+    std::vector<char> succeeded(jobs.size(), false);
+    std::vector<std::string> errors(jobs.size());
+    std::vector<std::function<void()>> tasks;
+    tasks.reserve(jobs.size());
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        tasks.emplace_back([&, i] {
+            try {
+                compile_job(jobs[i], cache.get(), options, compile_options);
+                succeeded[i] = true;
+            } catch (const CompileError &error) {
+                errors[i] = error.what();
+            } catch (const std::exception &error) {
+                errors[i] = jobs[i].input + ": " + error.what();
+            }
+        });
+    }
+
+    ThreadPool(threads).run(std::move(tasks));
+
+    int failures = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (succeeded[i]) {
+            std::cout << jobs[i].input << ": ok" << std::endl;
+        } else {
+            std::cerr << errors[i] << std::endl;
+            failures++;
+        }
+    }
+
+    if (memory_report) {
+        report_allocations(std::cerr);
+    }
+
+    return failures ? 1 : 0;
 }
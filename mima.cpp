@@ -0,0 +1,213 @@
+#include "mima.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#include "allocations.h"
+#include "bounded_queue.h"
+#include "error.h"
+#include "generator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "passes.h"
+
+namespace mima {
+
+static Diagnostic diagnostic(std::string_view source, const CompileError &error) {
+    Diagnostic diagnostic;
+    diagnostic.message = error.what();
+
+    // Errors point into the source, so the offset follows from the address
+    auto location = error.location();
+    if (location.data() < source.data() || location.data() > source.data() + source.size()) {
+        return diagnostic;
+    }
+
+    diagnostic.offset = location.data() - source.data();
+
+    auto before = source.substr(0, diagnostic.offset);
+    auto line_start = before.rfind('\n');
+
+    diagnostic.line = std::count(before.begin(), before.end(), '\n') + 1;
+    diagnostic.column = diagnostic.offset - (line_start == std::string_view::npos ? 0 : line_start + 1) + 1;
+
+    return diagnostic;
+}
+
+// The line starts are searched instead of counted for every word, as there is a word for every few characters
+static std::vector<SourceLocation> source_map(std::string_view source, const std::vector<SourceMapping> &mappings) {
+    std::vector<size_t> line_starts{0};
+    for (size_t offset = 0; offset < source.size(); offset++) {
+        if (source[offset] == '\n') {
+            line_starts.push_back(offset + 1);
+        }
+    }
+
+    std::vector<SourceLocation> locations;
+    locations.reserve(mappings.size());
+
+    for (const auto &mapping : mappings) {
+        size_t offset = mapping.location.data() - source.data();
+        size_t line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin();
+        locations.push_back({mapping.address, line, offset - line_starts[line - 1] + 1});
+    }
+
+    return locations;
+}
+
+// Batches of tokens and top-level statements waiting between the threads of a pipelined compilation
+static const size_t s_token_batches = 16;
+static const size_t s_statements = 256;
+
+// The parser stops once the generator gave up
+struct Cancelled { };
+
+// Errors are reported by phase like in a sequential compilation: a lexer error before a parser error before a generator
+// error, as the generator sees the statements in source order and every phase stops at its first error
+static void compile_pipelined(std::string_view source, std::ostream &output, const Options &options, PassManager &passes,
+                              Result &result) {
+    TokenQueue batches(s_token_batches);
+    BoundedQueue<std::shared_ptr<Statement>> statements(s_statements);
+    std::exception_ptr lexer_error;
+    std::exception_ptr parser_error;
+    std::exception_ptr generator_error;
+
+    std::jthread lexer([&] {
+        AllocationPhase phase("lex");
+
+        try {
+            Tokenization::lex_batches(source, batches);
+        } catch (...) {
+            lexer_error = std::current_exception();
+        }
+        batches.close();
+    });
+
+    std::jthread parser([&] {
+        AllocationPhase phase("parse");
+
+        try {
+            Tokenization tokenization(source, batches);
+            ParserNodeVisitor parser(tokenization);
+            parser.parse([&](std::shared_ptr<Statement> statement) {
+                if (!statements.push(std::move(statement))) {
+                    throw Cancelled();
+                }
+            });
+        } catch (const Cancelled &) {
+        } catch (...) {
+            parser_error = std::current_exception();
+        }
+        batches.close();
+        statements.close();
+    });
+
+    try {
+        GeneratorNodeVisitor generator(nullptr, {options.stack_base, options.stack_size},
+                                       generator_optimizations(options.optimization));
+        if (options.source_map) {
+            generator.map_locations();
+        }
+        generator.begin(output);
+
+        while (auto statement = statements.pop()) {
+            passes.run(statement->get());
+            passes.measure("generate", [&] {
+                generator.generate_statement(statement->get());
+                return 0;
+            });
+        }
+
+        passes.measure("generate", [&] {
+            generator.end();
+            return 0;
+        });
+
+        result.source_map = source_map(source, generator.get_locations());
+    } catch (...) {
+        generator_error = std::current_exception();
+    }
+    statements.close();
+
+    lexer.join();
+    parser.join();
+
+    for (const auto &error : {lexer_error, parser_error, generator_error}) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Compiles into output if it is set and into the result otherwise
+static Result compile(std::string_view source, std::ostream *output, const Options &options) {
+    Result result;
+
+    try {
+        PassManager passes(options.optimization);
+        std::ostringstream buffer;
+
+        if (options.pipelined && options.format == OutputFormat::Streamed && !options.log) {
+            compile_pipelined(source, output ? *output : buffer, options, passes, result);
+            result.assembly = buffer.str();
+        } else {
+            std::optional<Tokenization> tokenization;
+            passes.measure("lex", [&] {
+                tokenization.emplace(source, options.log);
+                return 0;
+            });
+
+            ParserNodeVisitor parser(*tokenization, options.log);
+            std::shared_ptr<Node> tree;
+            passes.measure("parse", [&] {
+                tree = parser.parse();
+                return 0;
+            });
+
+            passes.run(tree.get());
+
+            GeneratorNodeVisitor generator(options.log, {options.stack_base, options.stack_size},
+                                           generator_optimizations(options.optimization));
+            if (options.source_map) {
+                generator.map_locations();
+            }
+
+            passes.measure("generate", [&] {
+                if (options.format == OutputFormat::Streamed) {
+                    generator.generate(tree, output ? *output : buffer);
+                    result.assembly = buffer.str();
+                } else if (output) {
+                    *output << generator.generate(tree);
+                } else {
+                    result.assembly = generator.generate(tree);
+                }
+                return 0;
+            });
+
+            result.source_map = source_map(source, generator.get_locations());
+        }
+
+        result.success = true;
+
+        if (options.statistics) {
+            std::ostringstream report;
+            passes.report(report);
+            *options.statistics << report.str();
+        }
+    } catch (const CompileError &error) {
+        result.diagnostics.push_back(diagnostic(source, error));
+    }
+
+    return result;
+}
+
+Result compile(std::string_view source, const Options &options) {
+    return compile(source, nullptr, options);
+}
+
+Result compile(std::string_view source, std::ostream &output, const Options &options) {
+    return compile(source, &output, options);
+}
+
+}
@@ -0,0 +1,91 @@
+#ifndef MIMA_COMPILER_MIMA_H
+#define MIMA_COMPILER_MIMA_H
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Library entry point of the compiler. A compilation shares no mutable state with others,
+// so any number of them may run concurrently.
+namespace mima {
+
+// -O0 compiles fastest, -O1 balances, -O2 generates the fewest executed instructions and -Os the smallest image
+enum class OptimizationLevel {
+    O0,
+    O1,
+    O2,
+    Os,
+};
+
+// Aligned pads the columns to the longest label and declares the registers in front of the program, so the whole
+// assembly is built in memory. Streamed separates the columns by tabs and declares the registers after the program,
+// so the assembly is written to the output while it is generated.
+enum class OutputFormat {
+    Aligned,
+    Streamed,
+};
+
+struct Options {
+    // Receives the tokens, the AST and the generator trace if set
+    std::ostream *log{nullptr};
+
+    // Lowest address and number of cells of the stack, placed after the program and sized to its depth if unset
+    std::optional<int> stack_base{};
+    std::optional<int> stack_size{};
+
+    OptimizationLevel optimization{OptimizationLevel::O1};
+    OutputFormat format{OutputFormat::Aligned};
+
+    // Lexes, parses and generates on three threads, each top-level statement is generated and freed as soon as it is
+    // parsed. Only applies to the streamed format without a log.
+    bool pipelined{false};
+
+    // Receives the time and the number of changes of every pass if set
+    std::ostream *statistics{nullptr};
+
+    // Fills Result::source_map, which a profiler needs to attribute executed words to the source
+    bool source_map{false};
+};
+
+enum class Severity {
+    Error,
+};
+
+struct Diagnostic {
+    Severity severity{Severity::Error};
+    std::string message;
+
+    // Position in the source, line and column start at 1 and are 0 if unknown
+    size_t offset{0};
+    size_t line{0};
+    size_t column{0};
+};
+
+// Address of a word of the program and the position of the statement it was generated for, line and column start at 1
+struct SourceLocation {
+    int address{0};
+    size_t line{0};
+    size_t column{0};
+};
+
+struct Result {
+    bool success{false};
+    std::string assembly;
+    std::vector<Diagnostic> diagnostics;
+
+    // Every instruction and data cell a statement generated, in the order they are written. Constants and registers
+    // belong to no statement and are left out.
+    std::vector<SourceLocation> source_map;
+};
+
+Result compile(std::string_view source, const Options &options = {});
+
+// Writes the assembly to output instead of returning it; with diagnostics output may hold part of a streamed program
+Result compile(std::string_view source, std::ostream &output, const Options &options = {});
+
+}
+
+#endif //MIMA_COMPILER_MIMA_H
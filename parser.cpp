@@ -3,51 +3,28 @@
 #include <iostream>
 
 #include "debug.h"
+#include "error.h"
+
+// Addresses have 20 bits, so neither an origin nor an array can lie beyond them
+static const int s_memory_size = 1 << 20;
 
 void ParserNodeVisitor::assert_token(bool assertion) {
     if (assertion) {
         return;
     }
 
-    std::cerr << "Invalid token '" << m_tokens->peek().string << "' found" << std::endl;
-    exit(-1);
+    throw CompileError("Invalid token '" + std::string(m_last_token.string) + "' found", m_last_token.string);
 }
 
 Token ParserNodeVisitor::next() {
     Token token = m_tokens->peek();
 
     if (token.type == Invalid) {
-        std::cerr << "Unexpected EOF found" << std::endl;
-        exit(-1);
+        throw CompileError("Unexpected EOF found", m_last_token.string.substr(m_last_token.string.size()));
     }
 
     m_tokens->next();
-
-    return token;
-}
-
-Token ParserNodeVisitor::next_non_space() {
-    Token token = next();
-
-    while (token.type == Space) {
-        token = next();
-    }
-
-    return token;
-}
-
-Token ParserNodeVisitor::peek_next_non_space()
-{
-    int index = 0;
-    Token token = m_tokens->peek(index++);
-
-    while (token.type == Space) {
-        if (token.type == Invalid) {
-            return token;
-        }
-
-        token = m_tokens->peek(index++);
-    }
+    m_last_token = token;
 
     return token;
 }
@@ -59,352 +36,533 @@ std::shared_ptr<Statement> ParserNodeVisitor::ast_determine_statement()
     }
 
     auto token = m_tokens->peek();
-
-    if (token.type == Space && m_tokens->hasNext()) {
-        m_tokens->next();
-        token = m_tokens->peek();
-    }
-
-    if (token.string == "var") {
-        return std::make_shared<VarStatement>();
-    } else if (token.string == "[") {
-        return std::make_shared<OriginStatement>();
-    } else if (token.string == "if") {
-        return std::make_shared<ConditionalStatement>();
-    } else if (token.string == "while") {
-        return std::make_shared<WhileStatement>();
+    std::shared_ptr<Statement> statement;
+
+    if (token.kind == TokenKind::Var) {
+        statement = std::make_shared<VarStatement>();
+    } else if (token.kind == TokenKind::LeftBracket) {
+        statement = std::make_shared<OriginStatement>();
+    } else if (token.kind == TokenKind::If) {
+        statement = std::make_shared<ConditionalStatement>();
+    } else if (token.kind == TokenKind::While) {
+        statement = std::make_shared<WhileStatement>();
+    } else if (token.kind == TokenKind::Switch) {
+        statement = std::make_shared<SwitchStatement>();
     } else if (token.type == Identifier) {
-        return std::make_shared<AssignmentStatement>();
+        statement = std::make_shared<AssignmentStatement>();
+    } else {
+        return std::make_shared<EpsilonStatement>();
     }
 
-    return std::make_shared<EpsilonStatement>();
+    statement->set_location(token.string);
+    return statement;
 }
 
 void ParserNodeVisitor::visit_var_statement(VarStatement *node, int visit_count) {
-    Token token = next_non_space();
-    assert_token(token.string == "var");
+    Token token = next();
+    assert_token(token.kind == TokenKind::Var);
 
     token = next();
-    assert_token(token.type == Space);
-
-    token = next_non_space();
     assert_token(token.type == Identifier);
     node->set_identifier(token.string);
 
-    token = next_non_space();
+    token = next();
 
-    if (token.string == "=") {
+    if (token.kind == TokenKind::LeftBracket) {
+        token = next();
+        assert_token(token.type == Value && token.number > 0);
+        if (token.number > s_memory_size) {
+            throw CompileError("Array size out of range", token.string);
+        }
+        node->set_array_size(token.number);
+
+        token = next();
+        assert_token(token.kind == TokenKind::RightBracket);
+
+        token = next();
+    } else if (token.kind == TokenKind::Assign) {
         node->set_has_initial_value(true);
 
-        token = next_non_space();
+        token = next();
         assert_token(token.type == Value);
         node->set_number(token.number);
 
-        token = next_non_space();
+        token = next();
     }
 
-    assert_token(token.string == ";");
+    assert_token(token.kind == TokenKind::Semicolon);
 
-    node->set_next(ast_determine_statement());
+    link_next(node);
 }
 
 void ParserNodeVisitor::visit_assignment_statement(AssignmentStatement *node, int visit_count) {
     if (visit_count == 0) {
-        Token token = next_non_space();
+        Token token = next();
         assert_token(token.type == Identifier);
         node->set_identifier(token.string);
 
-        token = next_non_space();
-        assert_token(token.string == "=");
+        if (m_tokens->peek().kind == TokenKind::LeftBracket) {
+            node->set_element(parse_index_expression(token));
+            node->get_element()->set_store(true);
+        }
+
+        token = next();
+        assert_token(token.kind == TokenKind::Assign);
 
-        node->set_expression(std::make_shared<NumberExpression1>());
+        node->set_expression(parse_number_expression());
     } else {
-        Token token = next_non_space();
-        assert_token(token.string == ";");
+        Token token = next();
+        assert_token(token.kind == TokenKind::Semicolon);
 
-        node->set_next(ast_determine_statement());
+        link_next(node);
     }
 }
 
 void ParserNodeVisitor::visit_origin_statement(OriginStatement *node, int visit_count) {
-    Token token = next_non_space();
-    assert_token(token.string == "[");
-
-    token = next_non_space();
-    assert_token(token.string == "org");
+    Token token = next();
+    assert_token(token.kind == TokenKind::LeftBracket);
 
     token = next();
-    assert_token(token.type == Space);
+    assert_token(token.kind == TokenKind::Org);
 
-    token = next_non_space();
+    token = next();
     assert_token(token.type == Value);
+    if (token.number >= s_memory_size) {
+        throw CompileError("Origin out of range", token.string);
+    }
     node->set_number(token.number);
 
-    token = next_non_space();
-    assert_token(token.string == "]");
+    token = next();
+    assert_token(token.kind == TokenKind::RightBracket);
 
-    node->set_next(ast_determine_statement());
+    link_next(node);
 }
 
 void ParserNodeVisitor::visit_conditional_statement(ConditionalStatement *node, int visit_count) {
     if (visit_count == 0) {
-        Token token = next_non_space();
-        assert_token(token.string == "if");
+        Token token = next();
+        assert_token(token.kind == TokenKind::If);
 
-        token = next_non_space();
-        assert_token(token.string == "(");
+        token = next();
+        assert_token(token.kind == TokenKind::LeftParenthesis);
 
-        node->set_bool_expression(std::make_shared<BooleanExpression1>());
+        node->set_bool_expression(parse_boolean_expression());
     } else if (visit_count == 1) {
-        Token token = next_non_space();
-        assert_token(token.string == ")");
+        Token token = next();
+        assert_token(token.kind == TokenKind::RightParenthesis);
 
-        token = next_non_space();
-        assert_token(token.string == "{");
+        token = next();
+        assert_token(token.kind == TokenKind::LeftBrace);
 
         node->set_inner(ast_determine_statement());
     } else if (visit_count == 2) {
-        Token token = next_non_space();
-        assert_token(token.string == "}");
+        Token token = next();
+        assert_token(token.kind == TokenKind::RightBrace);
 
-        token = peek_next_non_space();
+        token = m_tokens->peek();
 
-        if (token.string == "else") {
-            next_non_space();
+        if (token.kind == TokenKind::Else) {
+            next();
 
-            token = peek_next_non_space();
+            token = m_tokens->peek();
 
-            if (token.string == "if") {
-                node->set_next(std::make_shared<ConditionalStatement>());
+            if (token.kind == TokenKind::If) {
+                auto else_if = std::make_shared<ConditionalStatement>();
+                else_if->set_else_if(true);
+                else_if->set_location(token.string);
+                node->set_else(else_if);
                 return;
             }
 
-            next_non_space();
-            assert_token(token.string == "{");
+            next();
+            assert_token(token.kind == TokenKind::LeftBrace);
 
             node->set_else(ast_determine_statement());
             return;
         }
 
-        node->set_next(ast_determine_statement());
+        link_next(node);
     } else if (node->get_else()) {
-        Token token = next_non_space();
-        assert_token(token.string == "}");
+        auto else_if = node_cast<ConditionalStatement>(node->get_else().get());
+
+        if (!else_if || !else_if->is_else_if()) {
+            Token token = next();
+            assert_token(token.kind == TokenKind::RightBrace);
+        }
+
+        link_next(node);
+    }
+}
+
+// The chain of an else if ends with it, the enclosing conditional continues after the whole chain.
+// A statement parsed on its own by parse(consume) is not linked either, the next one is handed out separately.
+void ParserNodeVisitor::link_next(Statement *node) {
+    if (node == m_top_level) {
+        return;
+    }
 
-        node->set_next(ast_determine_statement());
+    auto conditional = node_cast<ConditionalStatement>(node);
+    if (conditional && conditional->is_else_if()) {
+        node->set_next(std::make_shared<EpsilonStatement>());
+        return;
     }
+
+    node->set_next(ast_determine_statement());
 }
 
 void ParserNodeVisitor::visit_while_statement(WhileStatement *node, int visit_count) {
     if (visit_count == 0) {
-        Token token = next_non_space();
-        assert_token(token.string == "while");
+        Token token = next();
+        assert_token(token.kind == TokenKind::While);
 
-        token = next_non_space();
-        assert_token(token.string == "(");
+        token = next();
+        assert_token(token.kind == TokenKind::LeftParenthesis);
 
-        node->set_bool_expression(std::make_shared<BooleanExpression1>());
+        node->set_bool_expression(parse_boolean_expression());
     } else if (visit_count == 1) {
-        Token token = next_non_space();
-        assert_token(token.string == ")");
+        Token token = next();
+        assert_token(token.kind == TokenKind::RightParenthesis);
 
-        token = next_non_space();
-        assert_token(token.string == "{");
+        token = next();
+        assert_token(token.kind == TokenKind::LeftBrace);
 
         node->set_inner(ast_determine_statement());
     } else if (visit_count == 2) {
-        Token token = next_non_space();
-        assert_token(token.string == "}");
+        Token token = next();
+        assert_token(token.kind == TokenKind::RightBrace);
 
-        node->set_next(ast_determine_statement());
+        link_next(node);
     }
 }
 
-void ParserNodeVisitor::visit_epsilon_statement(EpsilonStatement *node, int visit_count) {
-    node->set_next(nullptr);
-}
+// Adds the case whose label comes next, its body ends at the next label or the closing brace
+void ParserNodeVisitor::parse_case(SwitchStatement *node) {
+    Token token = next();
+    SwitchCase switch_case;
 
-void ParserNodeVisitor::visit_number_expression_1(NumberExpression1 *node, int visit_count) {
-    if (visit_count == 0) {
-        node->set_expression(std::make_shared<NumberExpression2>());
-    } else if (visit_count == 1) {
-        Token token = peek_next_non_space();
+    if (token.kind == TokenKind::Default) {
+        if (node->has_default()) {
+            throw CompileError("Multiple default cases found", token.string);
+        }
+
+        switch_case.is_default = true;
+        switch_case.label = token.string;
+    } else {
+        assert_token(token.kind == TokenKind::Case);
+
+        token = next();
+        bool negative = token.kind == TokenKind::Minus;
+        const char *begin = token.string.data();
 
-        if (token.string == "&") {
-            next_non_space();
-            node->set_bitwise_and(std::make_shared<NumberExpression1>());
+        if (negative) {
+            token = next();
         }
+
+        assert_token(token.type == Value);
+        switch_case.value = negative ? -token.number : token.number;
+        switch_case.label = std::string_view(begin, token.string.data() + token.string.size() - begin);
     }
+
+    token = next();
+    assert_token(token.kind == TokenKind::Colon);
+
+    switch_case.body = ast_determine_statement();
+    node->add_case(std::move(switch_case));
 }
 
-void ParserNodeVisitor::visit_number_expression_2(NumberExpression2 *node, int visit_count) {
+void ParserNodeVisitor::visit_switch_statement(SwitchStatement *node, int visit_count) {
     if (visit_count == 0) {
-        node->set_expression(std::make_shared<NumberExpression3>());
+        Token token = next();
+        assert_token(token.kind == TokenKind::Switch);
+
+        token = next();
+        assert_token(token.kind == TokenKind::LeftParenthesis);
+
+        node->set_expression(parse_number_expression());
+        return;
     } else if (visit_count == 1) {
-        Token token = peek_next_non_space();
+        Token token = next();
+        assert_token(token.kind == TokenKind::RightParenthesis);
 
-        if (token.string == ">>") {
-            next_non_space();
-            node->set_bitshift(std::make_shared<NumberExpression2>());
-            node->set_left(false);
-        }
+        token = next();
+        assert_token(token.kind == TokenKind::LeftBrace);
     }
-}
 
-void ParserNodeVisitor::visit_number_expression_3(NumberExpression3 *node, int visit_count) {
-    if (visit_count == 0) {
-        node->set_expression(std::make_shared<NumberExpression4>());
-    } else if (visit_count == 1) {
-        Token token = peek_next_non_space();
+    TokenKind kind = m_tokens->peek().kind;
 
-        if (token.string == "+") {
-            next_non_space();
-            node->set_addition(std::make_shared<NumberExpression3>());
-        }
+    if (kind == TokenKind::Case || kind == TokenKind::Default) {
+        parse_case(node);
+        return;
     }
+
+    Token token = next();
+    assert_token(token.kind == TokenKind::RightBrace);
+
+    link_next(node);
 }
 
-void ParserNodeVisitor::visit_number_expression_4(NumberExpression4 *node, int visit_count) {
-    if (visit_count == 0) {
-        Token token = peek_next_non_space();
+void ParserNodeVisitor::visit_epsilon_statement(EpsilonStatement *node, int visit_count) {
+    node->set_next(nullptr);
+}
 
-        if (token.string == "-") {
-            next_non_space();
-            node->set_negated(true);
-        }
+// Binding power of a number operator, 0 if the token does not continue the expression
+static int number_precedence(TokenKind kind, BinaryOperator &op) {
+    switch (kind) {
+        case TokenKind::Ampersand: op = BitwiseAnd; return 1;
+        case TokenKind::ShiftRight: op = ShiftRight; return 2;
+        case TokenKind::Plus: op = Addition; return 3;
+        case TokenKind::Minus: op = Subtraction; return 3;
+        case TokenKind::Star: op = Multiplication; return 4;
+        case TokenKind::Slash: op = Division; return 4;
+        case TokenKind::Percent: op = Modulo; return 4;
+        default: return 0;
+    }
+}
 
-        node->set_expression(std::make_shared<NumberExpression5>());
+static int boolean_precedence(TokenKind kind, BinaryOperator &op) {
+    switch (kind) {
+        case TokenKind::LogicalOr: op = LogicalOr; return 1;
+        case TokenKind::LogicalAnd: op = LogicalAnd; return 2;
+        default: return 0;
     }
 }
 
-void ParserNodeVisitor::visit_number_expression_5(NumberExpression5 *node, int visit_count) {
-    if (visit_count == 0) {
-        Token token = peek_next_non_space();
-
-        if (token.string == "(") {
-            next_non_space();
-            node->set_expression(std::make_shared<NumberExpression1>());
-            node->set_nested(true);
-        } else if (token.type == Identifier) {
-            node->set_expression(std::make_shared<VariableExpression>());
-        } else if (token.type == Value) {
-            node->set_expression(std::make_shared<ValueExpression>());
-        } else {
-            std::cerr << "Invalid expression '" << token.string << "'" << std::endl;
-            exit(-1);
-        }
-    } else if (visit_count == 1 && node->is_nested()) {
-        Token token = next_non_space();
-        assert_token(token.string == ")");
+static bool comparison_operator(TokenKind kind, BinaryOperator &op) {
+    switch (kind) {
+        case TokenKind::Equal: op = Equals; return true;
+        case TokenKind::NotEqual: op = NotEquals; return true;
+        case TokenKind::Less: op = LessThan; return true;
+        case TokenKind::Greater: op = GreaterThan; return true;
+        case TokenKind::LessEqual: op = LessThanOrEqual; return true;
+        case TokenKind::GreaterEqual: op = GreaterThanOrEqual; return true;
+        default: return false;
     }
 }
 
-void ParserNodeVisitor::visit_boolean_expression_1(BooleanExpression1 *node, int visit_count) {
-    if (visit_count == 0) {
-        node->set_expression(std::make_shared<BooleanExpression2>());
-    } else if (visit_count == 1) {
-        Token token = peek_next_non_space();
+static std::shared_ptr<Node> binary_expression(BinaryOperator op, const Token &token, std::shared_ptr<Node> left,
+                                               std::shared_ptr<Node> right) {
+    auto node = std::make_shared<BinaryExpression>();
+    node->set_operator(op);
+    node->set_location(token.string);
+    node->set_left(std::move(left));
+    node->set_right(std::move(right));
+    return node;
+}
 
-        if (token.string == "||") {
-            next_non_space();
-            node->set_logical_or(std::make_shared<BooleanExpression1>());
+// Whether a node of a condition is a truth value rather than a number, which only a group hands back
+static bool is_boolean(Node *node) {
+    if (auto binary = node_cast<BinaryExpression>(node)) {
+        switch (binary->get_operator()) {
+            case LogicalAnd: case LogicalOr: case Equals: case NotEquals:
+            case LessThan: case GreaterThan: case LessThanOrEqual: case GreaterThanOrEqual:
+                return true;
+            default:
+                return false;
         }
+    } else if (auto unary = node_cast<UnaryExpression>(node)) {
+        return unary->get_operator() == LogicalNot;
     }
+
+    return node_cast<BooleanValueExpression>(node) != nullptr;
 }
 
-void ParserNodeVisitor::visit_boolean_expression_2(BooleanExpression2 *node, int visit_count) {
-    if (visit_count == 0) {
-        node->set_expression(std::make_shared<BooleanExpression3>());
-    } else if (visit_count == 1) {
-        Token token = peek_next_non_space();
+// Precedence climbing, only operators and operands become nodes. The operators group to the left,
+// so the right operand only takes operators that bind tighter.
+std::shared_ptr<Node> ParserNodeVisitor::parse_number_expression(int precedence) {
+    return parse_number_expression(parse_number_operand(), precedence);
+}
+
+// Continues an expression whose left operand is already parsed
+std::shared_ptr<Node> ParserNodeVisitor::parse_number_expression(std::shared_ptr<Node> left, int precedence) {
+    BinaryOperator op;
 
-        if (token.string == "&&") {
-            next_non_space();
-            node->set_logical_and(std::make_shared<BooleanExpression2>());
+    while (int operator_precedence = number_precedence(m_tokens->peek().kind, op)) {
+        if (operator_precedence < precedence) {
+            break;
         }
+
+        Token token = next();
+        left = binary_expression(op, token, std::move(left), parse_number_expression(operator_precedence + 1));
     }
+
+    return left;
 }
 
-void ParserNodeVisitor::visit_boolean_expression_3(BooleanExpression3 *node, int visit_count) {
-    if (visit_count == 0) {
-        Token token = peek_next_non_space();
+std::shared_ptr<Node> ParserNodeVisitor::parse_number_operand() {
+    Token token = next();
 
-        if (token.string == "!") {
-            next_non_space();
-            node->set_negated(true);
-        }
+    if (token.kind == TokenKind::Minus) {
+        auto node = std::make_shared<UnaryExpression>();
+        node->set_operator(Negation);
+        node->set_expression(parse_number_primary(next()));
+        return node;
+    }
+
+    return parse_number_primary(token);
+}
 
-        node->set_expression(std::make_shared<BooleanExpression4>());
+std::shared_ptr<Node> ParserNodeVisitor::parse_number_primary(const Token &token) {
+    if (token.kind == TokenKind::LeftParenthesis) {
+        auto expression = parse_number_expression();
+        assert_token(next().kind == TokenKind::RightParenthesis);
+        return expression;
+    } else if (token.type == Identifier && m_tokens->peek().kind == TokenKind::LeftBracket) {
+        return parse_index_expression(token);
+    } else if (token.type == Identifier) {
+        auto node = std::make_shared<VariableExpression>();
+        node->set_identifier(token.string);
+        return node;
+    } else if (token.type == Value) {
+        auto node = std::make_shared<ValueExpression>();
+        node->set_number(token.number);
+        return node;
     }
+
+    throw CompileError("Invalid expression '" + std::string(token.string) + "'", token.string);
 }
 
-void ParserNodeVisitor::visit_boolean_expression_4(BooleanExpression4 *node, int visit_count) {
-    if (visit_count == 0) {
-        Token token = peek_next_non_space();
-
-        if (token.string == "(") {
-            next_non_space();
-            node->set_expression(std::make_shared<BooleanExpression1>());
-            node->set_nested(true);
-        } else if (token.string == "true" | token.string == "false") {
-            node->set_expression(std::make_shared<BooleanValueExpression>());
-        } else {
-            node->set_is_comparison(true);
-            node->set_left(std::make_shared<NumberExpression1>());
-        }
-    } else if (visit_count == 1 && node->is_nested()) {
-        Token token = next_non_space();
-        assert_token(token.string == ")");
-    } else if (visit_count == 1 && node->is_comparison()) {
-        Token token = next_non_space();
-
-        if (token.string == "==") {
-            node->set_comparison(Equals);
-        } else if (token.string == "!=") {
-            node->set_comparison(NotEquals);
-        } else if (token.string == "<") {
-            node->set_comparison(LessThan);
-        } else if (token.string == ">") {
-            node->set_comparison(GreaterThan);
-        } else if (token.string == "<=") {
-            node->set_comparison(LessThanOrEqual);
-        } else if (token.string == ">=") {
-            node->set_comparison(GreaterThanOrEqual);
-        } else {
-            std::cerr << "Invalid operator '" << token.string << "'" << std::endl;
-            exit(-1);
+std::shared_ptr<IndexExpression> ParserNodeVisitor::parse_index_expression(const Token &identifier) {
+    auto node = std::make_shared<IndexExpression>();
+    node->set_identifier(identifier.string);
+
+    Token token = next();
+    assert_token(token.kind == TokenKind::LeftBracket);
+
+    node->set_index(parse_number_expression());
+
+    token = next();
+    assert_token(token.kind == TokenKind::RightBracket);
+
+    return node;
+}
+
+// The first operand of a group may be a number, which is then the whole group
+std::shared_ptr<Node> ParserNodeVisitor::parse_boolean_expression(int precedence, bool group) {
+    auto left = parse_boolean_operand(group);
+    BinaryOperator op;
+
+    if (!is_boolean(left.get())) {
+        return left;
+    }
+
+    while (int operator_precedence = boolean_precedence(m_tokens->peek().kind, op)) {
+        if (operator_precedence < precedence) {
+            break;
         }
 
-        node->set_right(std::make_shared<NumberExpression1>());
+        Token token = next();
+        left = binary_expression(op, token, std::move(left), parse_boolean_expression(operator_precedence + 1));
     }
+
+    return left;
 }
 
-void ParserNodeVisitor::visit_variable_expression(VariableExpression *node, int visit_count) {
-    Token token = next_non_space();
-    assert_token(token.type == Identifier);
-    node->set_identifier(token.string);
+std::shared_ptr<Node> ParserNodeVisitor::parse_boolean_operand(bool group) {
+    Token token = m_tokens->peek();
+
+    if (token.kind == TokenKind::LogicalNot) {
+        next();
+
+        auto node = std::make_shared<UnaryExpression>();
+        node->set_operator(LogicalNot);
+        node->set_expression(parse_boolean_primary());
+        return node;
+    }
+
+    return parse_boolean_primary(group);
 }
 
-void ParserNodeVisitor::visit_value_expression(ValueExpression *node, int visit_count) {
-    Token token = next_non_space();
-    assert_token(token.type == Value);
-    node->set_number(token.number);
+// A group holding a single number expression, as in "(x & m) == 0", is the start of the comparison's left operand.
+// The tokens can only be looked at once, so a group is parsed as a condition until it turns out to be a number.
+std::shared_ptr<Node> ParserNodeVisitor::parse_boolean_primary(bool group) {
+    Token token = m_tokens->peek();
+    std::shared_ptr<Node> left;
+
+    if (token.kind == TokenKind::LeftParenthesis) {
+        next();
+        auto expression = parse_boolean_expression(1, true);
+        assert_token(next().kind == TokenKind::RightParenthesis);
+
+        if (is_boolean(expression.get())) {
+            return expression;
+        }
+
+        left = parse_number_expression(std::move(expression));
+    } else if (token.kind == TokenKind::True || token.kind == TokenKind::False) {
+        next();
+        auto node = std::make_shared<BooleanValueExpression>();
+        node->set_value(token.kind == TokenKind::True);
+        return node;
+    } else {
+        left = parse_number_expression();
+    }
+
+    // The number is compared once the enclosing group is closed
+    if (group && m_tokens->peek().kind == TokenKind::RightParenthesis) {
+        return left;
+    }
+
+    token = next();
+    BinaryOperator op;
+
+    if (!comparison_operator(token.kind, op)) {
+        throw CompileError("Invalid operator '" + std::string(token.string) + "'", token.string);
+    }
+
+    return binary_expression(op, token, std::move(left), parse_number_expression());
 }
 
-void ParserNodeVisitor::visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) {
-    Token token = next_non_space();
-    assert_token(token.string == "true" | token.string == "false");
-    node->set_value(token.string == "true");
+// Expressions are built completely by the parse_* functions before they are visited
+void ParserNodeVisitor::visit_binary_expression(BinaryExpression *node, int visit_count) { }
+
+void ParserNodeVisitor::visit_unary_expression(UnaryExpression *node, int visit_count) { }
+
+void ParserNodeVisitor::visit_index_expression(IndexExpression *node, int visit_count) { }
+
+void ParserNodeVisitor::visit_variable_expression(VariableExpression *node, int visit_count) { }
+
+void ParserNodeVisitor::visit_value_expression(ValueExpression *node, int visit_count) { }
+
+void ParserNodeVisitor::visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) { }
+
+void ParserNodeVisitor::expect_end() {
+    if (m_tokens->hasNext()) {
+        Token token = m_tokens->peek();
+        throw CompileError("Unexpected token '" + std::string(token.string) + "' found", token.string);
+    }
 }
 
 std::shared_ptr<Node> ParserNodeVisitor::parse() {
     auto root = ast_determine_statement();
-    root->visit(*this);
+    visit(root.get());
 
-    PrinterNodeVisitor visitor;
-    std::cout << "AST: " << std::endl;
-    visitor.print_tree(root.get());
-    std::cout << std::endl;
+    expect_end();
+
+    if (m_log) {
+        PrinterNodeVisitor visitor(*m_log);
+        *m_log << "AST: " << std::endl;
+        visitor.print_tree(root.get());
+        *m_log << std::endl;
+    }
 
     return root;
-}
\ No newline at end of file
+}
+
+void ParserNodeVisitor::parse(const std::function<void(std::shared_ptr<Statement>)> &consume) {
+    while (true) {
+        auto statement = ast_determine_statement();
+        bool last = statement->get_kind() == NodeKind::EpsilonStatement;
+
+        m_top_level = statement.get();
+        visit(statement.get());
+        m_top_level = nullptr;
+
+        consume(std::move(statement));
+
+        if (last) {
+            break;
+        }
+    }
+
+    expect_end();
+}
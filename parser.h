@@ -1,46 +1,62 @@
 #ifndef MIMA_COMPILER_PARSER_H
 #define MIMA_COMPILER_PARSER_H
 
+#include <functional>
+
 #include "ast.h"
 #include "lexer.h"
 
-class ParserNodeVisitor : public NodeVisitor {
+class ParserNodeVisitor : public NodeVisitor<ParserNodeVisitor> {
 public:
-    explicit ParserNodeVisitor(Tokenization &tokens)
+    explicit ParserNodeVisitor(Tokenization &tokens, std::ostream *log = nullptr)
         : m_tokens(&tokens)
+        , m_log(log)
     { }
 
     std::shared_ptr<Node> parse();
 
+    // Hands out every top-level statement as soon as it is parsed, unlinked from the next one and ending with an epsilon
+    void parse(const std::function<void(std::shared_ptr<Statement>)> &consume);
+
 private:
     void assert_token(bool assertion);
 
     Token next();
-    Token next_non_space();
-    Token peek_next_non_space();
 
     std::shared_ptr<Statement> ast_determine_statement();
-
-    void visit_var_statement(VarStatement *node, int visit_count) override;
-    void visit_assignment_statement(AssignmentStatement *node, int visit_count) override;
-    void visit_origin_statement(OriginStatement *node, int visit_count) override;
-    void visit_conditional_statement(ConditionalStatement *node, int visit_count) override;
-    void visit_while_statement(WhileStatement *node, int visit_count) override;
-    void visit_epsilon_statement(EpsilonStatement *node, int visit_count) override;
-    void visit_number_expression_1(NumberExpression1 *node, int visit_count) override;
-    void visit_number_expression_2(NumberExpression2 *node, int visit_count) override;
-    void visit_number_expression_3(NumberExpression3 *node, int visit_count) override;
-    void visit_number_expression_4(NumberExpression4 *node, int visit_count) override;
-    void visit_number_expression_5(NumberExpression5 *node, int visit_count) override;
-    void visit_boolean_expression_1(BooleanExpression1 *node, int visit_count) override;
-    void visit_boolean_expression_2(BooleanExpression2 *node, int visit_count) override;
-    void visit_boolean_expression_3(BooleanExpression3 *node, int visit_count) override;
-    void visit_boolean_expression_4(BooleanExpression4 *node, int visit_count) override;
-    void visit_variable_expression(VariableExpression *node, int visit_count) override;
-    void visit_value_expression(ValueExpression *node, int visit_count) override;
-    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) override;
+    void link_next(Statement *node);
+    void parse_case(SwitchStatement *node);
+    void expect_end();
+
+    std::shared_ptr<Node> parse_number_expression(int precedence = 1);
+    std::shared_ptr<Node> parse_number_expression(std::shared_ptr<Node> left, int precedence = 1);
+    std::shared_ptr<Node> parse_number_operand();
+    std::shared_ptr<Node> parse_number_primary(const Token &token);
+    std::shared_ptr<IndexExpression> parse_index_expression(const Token &identifier);
+    std::shared_ptr<Node> parse_boolean_expression(int precedence = 1, bool group = false);
+    std::shared_ptr<Node> parse_boolean_operand(bool group = false);
+    std::shared_ptr<Node> parse_boolean_primary(bool group = false);
+
+    friend class NodeVisitor<ParserNodeVisitor>;
+
+    void visit_var_statement(VarStatement *node, int visit_count);
+    void visit_assignment_statement(AssignmentStatement *node, int visit_count);
+    void visit_origin_statement(OriginStatement *node, int visit_count);
+    void visit_conditional_statement(ConditionalStatement *node, int visit_count);
+    void visit_while_statement(WhileStatement *node, int visit_count);
+    void visit_switch_statement(SwitchStatement *node, int visit_count);
+    void visit_epsilon_statement(EpsilonStatement *node, int visit_count);
+    void visit_binary_expression(BinaryExpression *node, int visit_count);
+    void visit_unary_expression(UnaryExpression *node, int visit_count);
+    void visit_index_expression(IndexExpression *node, int visit_count);
+    void visit_variable_expression(VariableExpression *node, int visit_count);
+    void visit_value_expression(ValueExpression *node, int visit_count);
+    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count);
 
     Tokenization *m_tokens;
+    std::ostream *m_log;
+    Token m_last_token{};
+    Statement *m_top_level{nullptr};
 };
 
 #endif //MIMA_COMPILER_PARSER_H
@@ -0,0 +1,453 @@
+#include "passes.h"
+
+#include <bit>
+#include <iomanip>
+
+#include "allocations.h"
+
+int wrap(long long value) {
+    value &= 0xFFFFFF;
+    return (int)(value & 0x800000 ? value - 0x1000000 : value);
+}
+
+// Both operands are evaluated like the generated code does, >> and / shift logically
+static std::optional<int> evaluate(BinaryOperator op, int left, int right) {
+    switch (op) {
+        case BitwiseAnd: return wrap(left & right);
+        case Addition: return wrap((long long)left + right);
+        case Subtraction: return wrap((long long)left - right);
+        case Multiplication: return wrap((long long)left * right);
+        case ShiftRight:
+            // A count of 0x800000 or more is negative in the cell the loop counts down
+            right = wrap(right);
+            if (right <= 0) {
+                return wrap(left);
+            }
+            return right >= 24 ? 0 : wrap((left & 0xFFFFFF) >> right);
+        case Division:
+        case Modulo:
+            if (right <= 0 || !std::has_single_bit((unsigned)right)) {
+                return std::nullopt;
+            }
+            return wrap(op == Division ? (left & 0xFFFFFF) >> std::countr_zero((unsigned)right) : left & (right - 1));
+        default:
+            return std::nullopt;
+    }
+}
+
+// Comparisons look at the sign of the 24 bit difference like the generated code
+static std::optional<bool> compare(BinaryOperator op, int left, int right) {
+    switch (op) {
+        case Equals: return wrap(left) == wrap(right);
+        case NotEquals: return wrap(left) != wrap(right);
+        case LessThan: return wrap((long long)left - right) < 0;
+        case GreaterThan: return wrap((long long)right - left) < 0;
+        case LessThanOrEqual: return wrap((long long)right - left) >= 0;
+        case GreaterThanOrEqual: return wrap((long long)left - right) >= 0;
+        default: return std::nullopt;
+    }
+}
+
+std::optional<int> constant_value(Node *node) {
+    if (auto expression = node_cast<UnaryExpression>(node)) {
+        auto value = constant_value(expression->get_expression().get());
+        return value && expression->get_operator() == Negation ? std::optional(-*value) : std::nullopt;
+    } else if (auto expression = node_cast<ValueExpression>(node)) {
+        return expression->get_number();
+    } else if (auto expression = node_cast<BinaryExpression>(node)) {
+        // Operands folded into the node by the generator leave no right node and are not constant
+        auto left = constant_value(expression->get_left().get());
+        auto right = constant_value(expression->get_right().get());
+
+        if (left && right) {
+            return evaluate(expression->get_operator(), *left, *right);
+        }
+    }
+
+    return std::nullopt;
+}
+
+bool is_direct_operand(Node *node) {
+    return node_cast<VariableExpression>(node) || constant_value(node);
+}
+
+static std::optional<bool> boolean_value(Node *node) {
+    if (auto expression = node_cast<BooleanValueExpression>(node)) {
+        return expression->get_value() != 0;
+    }
+
+    return std::nullopt;
+}
+
+// Operators whose chains may be regrouped, a op (b op c) == (a op b) op c
+static bool is_associative(BinaryOperator op) {
+    return op == BitwiseAnd || op == Addition || op == LogicalOr || op == LogicalAnd;
+}
+
+// The operator with its operands swapped, the ordered comparisons turn around; nothing for non-commutative ones
+static std::optional<BinaryOperator> swapped_operator(BinaryOperator op) {
+    switch (op) {
+        case LessThan: return GreaterThan;
+        case GreaterThan: return LessThan;
+        case LessThanOrEqual: return GreaterThanOrEqual;
+        case GreaterThanOrEqual: return LessThanOrEqual;
+        case ShiftRight:
+        case Subtraction:
+        case Division:
+        case Modulo: return std::nullopt;
+        default: return op;
+    }
+}
+
+// Regroups expressions so the generator can take operands directly instead of pushing them:
+// a op (b op c) becomes (a op b) op c for associative operators and a direct operand on the left is swapped to the right.
+// Subtraction is brought into the forms that need no stack: a - c becomes a + (-c) with c negated at compile time,
+// a + -e becomes a - e and a - e becomes -e + a when only a can be addressed directly.
+class ReassociatePass : public NodeVisitor<ReassociatePass> {
+public:
+    size_t run(Node *tree) {
+        visit(tree);
+        return m_changes;
+    }
+
+private:
+    friend class NodeVisitor<ReassociatePass>;
+
+    void rewrite_subtraction(BinaryExpression *node);
+
+    void visit_var_statement(VarStatement *node, int visit_count) { }
+    void visit_assignment_statement(AssignmentStatement *node, int visit_count) { }
+    void visit_origin_statement(OriginStatement *node, int visit_count) { }
+    void visit_conditional_statement(ConditionalStatement *node, int visit_count) { }
+    void visit_while_statement(WhileStatement *node, int visit_count) { }
+    void visit_switch_statement(SwitchStatement *node, int visit_count) { }
+    void visit_epsilon_statement(EpsilonStatement *node, int visit_count) { }
+    void visit_binary_expression(BinaryExpression *node, int visit_count);
+    void visit_unary_expression(UnaryExpression *node, int visit_count) { }
+    void visit_index_expression(IndexExpression *node, int visit_count) { }
+    void visit_variable_expression(VariableExpression *node, int visit_count) { }
+    void visit_value_expression(ValueExpression *node, int visit_count) { }
+    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) { }
+
+    size_t m_changes{0};
+};
+
+void ReassociatePass::rewrite_subtraction(BinaryExpression *node) {
+    BinaryOperator op = node->get_operator();
+    auto negation = node_cast<UnaryExpression>(node->get_right().get());
+
+    if (op == Addition && negation && negation->get_operator() == Negation && !constant_value(negation)) {
+        node->set_operator(Subtraction);
+        node->set_right(negation->get_expression());
+        m_changes++;
+    } else if (op != Subtraction) {
+        return;
+    }
+
+    if (auto constant = constant_value(node->get_right().get())) {
+        auto value = std::make_shared<ValueExpression>();
+        value->set_number(-*constant);
+        node->set_operator(Addition);
+        node->set_right(std::move(value));
+        m_changes++;
+    } else if (is_direct_operand(node->get_left().get()) && !is_direct_operand(node->get_right().get())) {
+        auto negated = std::make_shared<UnaryExpression>();
+        negated->set_operator(Negation);
+        negated->set_expression(node->get_right());
+        node->set_operator(Addition);
+        node->set_right(node->get_left());
+        node->set_left(std::move(negated));
+        m_changes++;
+    }
+}
+
+void ReassociatePass::visit_binary_expression(BinaryExpression *node, int visit_count) {
+    if (visit_count != 0) {
+        return;
+    }
+
+    rewrite_subtraction(node);
+    BinaryOperator op = node->get_operator();
+
+    if (is_associative(op)) {
+        while (auto right = node_cast<BinaryExpression>(node->get_right().get())) {
+            if (right->get_operator() != op) {
+                break;
+            }
+
+            std::shared_ptr<Node> inner = node->get_right();
+            std::shared_ptr<Node> outer_right = right->get_right();
+            right->set_right(right->get_left());
+            right->set_left(node->get_left());
+            node->set_left(std::move(inner));
+            node->set_right(std::move(outer_right));
+            m_changes++;
+        }
+    }
+
+    auto swapped = swapped_operator(op);
+
+    if (swapped && is_direct_operand(node->get_left().get()) && !is_direct_operand(node->get_right().get())) {
+        std::shared_ptr<Node> left = node->get_left();
+        node->set_left(node->get_right());
+        node->set_right(std::move(left));
+        node->set_operator(*swapped);
+        m_changes++;
+    }
+}
+
+// Replaces constant expressions by their value, merges constants of (x + c) + c
+// and drops operations that leave their operand unchanged (x + 0, x * 1, b && true, ...)
+class ConstantFoldingPass : public NodeVisitor<ConstantFoldingPass> {
+public:
+    size_t run(Node *tree) {
+        visit(tree);
+        return m_changes;
+    }
+
+private:
+    friend class NodeVisitor<ConstantFoldingPass>;
+
+    std::shared_ptr<Node> fold(const std::shared_ptr<Node> &node);
+    std::shared_ptr<Node> fold_binary(const std::shared_ptr<Node> &node, BinaryExpression *expression);
+    std::shared_ptr<Node> number(int value);
+    std::shared_ptr<Node> boolean(bool value);
+
+    void visit_var_statement(VarStatement *node, int visit_count) { }
+    void visit_assignment_statement(AssignmentStatement *node, int visit_count);
+    void visit_origin_statement(OriginStatement *node, int visit_count) { }
+    void visit_conditional_statement(ConditionalStatement *node, int visit_count);
+    void visit_while_statement(WhileStatement *node, int visit_count);
+    void visit_switch_statement(SwitchStatement *node, int visit_count);
+    void visit_epsilon_statement(EpsilonStatement *node, int visit_count) { }
+    void visit_binary_expression(BinaryExpression *node, int visit_count) { }
+    void visit_unary_expression(UnaryExpression *node, int visit_count) { }
+    void visit_index_expression(IndexExpression *node, int visit_count) { }
+    void visit_variable_expression(VariableExpression *node, int visit_count) { }
+    void visit_value_expression(ValueExpression *node, int visit_count) { }
+    void visit_boolean_value_expression(BooleanValueExpression *node, int visit_count) { }
+
+    size_t m_changes{0};
+};
+
+std::shared_ptr<Node> ConstantFoldingPass::number(int value) {
+    auto node = std::make_shared<ValueExpression>();
+    node->set_number(value);
+    m_changes++;
+
+    return node;
+}
+
+std::shared_ptr<Node> ConstantFoldingPass::boolean(bool value) {
+    auto node = std::make_shared<BooleanValueExpression>();
+    node->set_value(value);
+    m_changes++;
+
+    return node;
+}
+
+// Returns the node that replaces the expression, the expression itself if nothing is folded
+std::shared_ptr<Node> ConstantFoldingPass::fold(const std::shared_ptr<Node> &node) {
+    if (auto expression = node_cast<BinaryExpression>(node.get())) {
+        expression->set_left(fold(expression->get_left()));
+        expression->set_right(fold(expression->get_right()));
+        return fold_binary(node, expression);
+    } else if (auto expression = node_cast<UnaryExpression>(node.get())) {
+        expression->set_expression(fold(expression->get_expression()));
+
+        if (auto value = boolean_value(expression->get_expression().get())) {
+            return boolean(!*value);
+        } else if (node_cast<ValueExpression>(expression->get_expression().get())) {
+            return number(*constant_value(node.get()));
+        }
+    } else if (auto expression = node_cast<IndexExpression>(node.get())) {
+        expression->set_index(fold(expression->get_index()));
+    }
+
+    return node;
+}
+
+std::shared_ptr<Node> ConstantFoldingPass::fold_binary(const std::shared_ptr<Node> &node, BinaryExpression *expression) {
+    BinaryOperator op = expression->get_operator();
+    const std::shared_ptr<Node> &left = expression->get_left();
+    const std::shared_ptr<Node> &right = expression->get_right();
+
+    auto left_value = constant_value(left.get());
+    auto right_value = constant_value(right.get());
+
+    if (left_value && right_value) {
+        if (auto value = evaluate(op, *left_value, *right_value)) {
+            return number(*value);
+        } else if (auto result = compare(op, *left_value, *right_value)) {
+            return boolean(*result);
+        }
+    }
+
+    auto left_boolean = boolean_value(left.get());
+    auto right_boolean = boolean_value(right.get());
+
+    if (op == LogicalAnd || op == LogicalOr) {
+        // true && b is b, false && b is false; || the other way around
+        bool neutral = op == LogicalAnd;
+        auto constant = left_boolean ? left_boolean : right_boolean;
+
+        if (!constant) {
+            return node;
+        } else if (*constant != neutral) {
+            return boolean(!neutral);
+        }
+
+        m_changes++;
+        return left_boolean ? right : left;
+    }
+
+    if (!right_value) {
+        return node;
+    }
+
+    switch (op) {
+        case Addition:
+        case Subtraction:
+            if (*right_value == 0) {
+                m_changes++;
+                return left;
+            }
+
+            // (x + c1) + c2 becomes x + (c1 + c2)
+            if (auto inner = node_cast<BinaryExpression>(left.get()); inner && inner->get_operator() == Addition) {
+                if (auto inner_value = constant_value(inner->get_right().get())) {
+                    int sum = op == Addition ? *inner_value + *right_value : *inner_value - *right_value;
+                    inner->set_right(number(wrap(sum)));
+                    return left;
+                }
+            }
+            break;
+        case Multiplication:
+        case Division:
+            if (*right_value == 1) {
+                m_changes++;
+                return left;
+            } else if (*right_value == 0 && op == Multiplication) {
+                return number(0);
+            }
+            break;
+        case Modulo:
+            if (*right_value == 1) {
+                return number(0);
+            }
+            break;
+        case BitwiseAnd:
+            if (*right_value == 0) {
+                return number(0);
+            }
+            break;
+        case ShiftRight:
+            if (*right_value <= 0) {
+                m_changes++;
+                return left;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return node;
+}
+
+void ConstantFoldingPass::visit_assignment_statement(AssignmentStatement *node, int visit_count) {
+    if (visit_count == 0) {
+        node->set_expression(fold(node->get_expression()));
+
+        if (node->get_element()) {
+            node->get_element()->set_index(fold(node->get_element()->get_index()));
+        }
+    }
+}
+
+void ConstantFoldingPass::visit_conditional_statement(ConditionalStatement *node, int visit_count) {
+    if (visit_count == 0) {
+        node->set_bool_expression(fold(node->get_bool_expression()));
+    }
+}
+
+void ConstantFoldingPass::visit_while_statement(WhileStatement *node, int visit_count) {
+    if (visit_count == 0) {
+        node->set_bool_expression(fold(node->get_bool_expression()));
+    }
+}
+
+void ConstantFoldingPass::visit_switch_statement(SwitchStatement *node, int visit_count) {
+    if (visit_count == 0) {
+        node->set_expression(fold(node->get_expression()));
+    }
+}
+
+// Levels a pass runs at, as bits of mima::OptimizationLevel
+static constexpr unsigned level_bit(mima::OptimizationLevel level) {
+    return 1u << (unsigned)level;
+}
+
+static constexpr unsigned s_optimizing = level_bit(mima::OptimizationLevel::O1) | level_bit(mima::OptimizationLevel::O2)
+    | level_bit(mima::OptimizationLevel::Os);
+
+struct PassEntry {
+    const char *name;
+    unsigned levels;
+    size_t (*run)(Node *tree);
+};
+
+// Passes run in this order, a new pass only needs an entry here
+static const PassEntry s_passes[] = {
+    {"reassociate", s_optimizing, [](Node *tree) { return ReassociatePass().run(tree); }},
+    {"fold-constants", s_optimizing, [](Node *tree) { return ConstantFoldingPass().run(tree); }},
+};
+
+GeneratorOptimizations generator_optimizations(mima::OptimizationLevel level) {
+    switch (level) {
+        case mima::OptimizationLevel::O0:
+            return {.track_accumulator = false, .search_addition_chains = false, .loop_pointers = false, .unroll_shifts = false,
+                .switch_tables = false};
+        case mima::OptimizationLevel::O2:
+            return {.unroll_long_shifts = true};
+        case mima::OptimizationLevel::Os:
+            return {.prefer_size = true};
+        default:
+            return {};
+    }
+}
+
+void PassManager::run(Node *tree) {
+    for (const auto &pass : s_passes) {
+        if (pass.levels & level_bit(m_level)) {
+            measure(pass.name, [&] { return pass.run(tree); });
+        }
+    }
+}
+
+void PassManager::measure(const char *name, const std::function<size_t()> &step) {
+    AllocationPhase phase(name);
+    auto start = std::chrono::steady_clock::now();
+    size_t changes = step();
+    auto time = std::chrono::steady_clock::now() - start;
+
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time);
+
+    // Statements compiled one at a time add up under the same name
+    for (auto &statistics : m_statistics) {
+        if (std::string_view(statistics.name) == name) {
+            statistics.changes += changes;
+            statistics.time += nanoseconds;
+            return;
+        }
+    }
+
+    m_statistics.push_back({name, changes, nanoseconds});
+}
+
+void PassManager::report(std::ostream &stream) const {
+    for (const auto &statistics : m_statistics) {
+        stream << std::left << std::setw(16) << statistics.name << std::right
+               << std::setw(10) << std::fixed << std::setprecision(3) << statistics.time.count() / 1e6 << " ms"
+               << std::setw(8) << statistics.changes << " changes" << std::endl;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef MIMA_COMPILER_PASSES_H
+#define MIMA_COMPILER_PASSES_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+#include "ast.h"
+#include "mima.h"
+
+// Wraps around like the 24 bit AKKU, the result is the word read as a signed number
+int wrap(long long value);
+
+// Value of a constant number expression with the 24 bit wrap-around of AKKU, nothing if it depends on a variable
+std::optional<int> constant_value(Node *node);
+
+// Variables and constants can be the memory operand of an instruction without being loaded first
+bool is_direct_operand(Node *node);
+
+// Choices the generator makes while emitting code, selected by the optimization level
+struct GeneratorOptimizations {
+    // Drop loads and stores of values AKKU already holds
+    bool track_accumulator{true};
+    // Search for the shortest addition chain of a constant factor instead of using the binary method
+    bool search_addition_chains{true};
+    // Address array elements in loops through pointer cells that step along with the index
+    bool loop_pointers{true};
+    // Shift by a constant with a sequence of RAR instead of the loop
+    bool unroll_shifts{true};
+    // Also unroll shifts whose sequence is longer than the loop
+    bool unroll_long_shifts{false};
+    // Dispatch switch statements with dense case values through a jump table instead of a binary search
+    bool switch_tables{true};
+    // Weigh code size instead of executed instructions where both differ
+    bool prefer_size{false};
+};
+
+GeneratorOptimizations generator_optimizations(mima::OptimizationLevel level);
+
+// Time and number of changes of one pass
+struct PassStatistics {
+    const char *name;
+    size_t changes;
+    std::chrono::nanoseconds time;
+};
+
+// Runs the AST passes of an optimization level in the order of the pass table and measures each of them
+class PassManager {
+public:
+    explicit PassManager(mima::OptimizationLevel level)
+        : m_level(level)
+    { }
+
+    void run(Node *tree);
+
+    // Runs and measures a step outside of the table, like the generator. Repeated steps and passes add up.
+    void measure(const char *name, const std::function<size_t()> &step);
+
+    [[nodiscard]] const std::vector<PassStatistics> &get_statistics() const { return m_statistics; }
+    void report(std::ostream &stream) const;
+
+private:
+    mima::OptimizationLevel m_level;
+    std::vector<PassStatistics> m_statistics{};
+};
+
+#endif //MIMA_COMPILER_PASSES_H
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "simulator.h"
+
+// Runs a program compiled with --source-map on a simulated MiMa and reports the executed instructions and clock cycles
+// of every source line, read from the "<address> <file>:<line>:<column>" lines of the map next to the assembly.
+// Usage: MIMA_Profiler [--steps <limit>] [--top <lines>] <assembly> [<map>]
+
+static const size_t s_bar_width = 20;
+
+struct SourceLine {
+    uint64_t executions{0};
+    uint64_t cycles{0};
+    // Executions of its most executed word, the number of times a statement ran or a loop condition was checked
+    uint64_t runs{0};
+    bool has_code{false};
+};
+
+// Lines by number for each file of the map, in the order the files appear
+struct SourceFile {
+    std::string path;
+    std::map<size_t, SourceLine> lines;
+};
+
+static std::vector<SourceFile> attribute(std::istream &map, const Profile &profile, uint64_t &unattributed) {
+    std::vector<SourceFile> files;
+    std::vector<bool> attributed(s_memory_size);
+    std::string text;
+
+    for (size_t number = 1; std::getline(map, text); number++) {
+        // "<address> <file>:<line>:<column>", the file name may contain colons itself
+        auto space = text.find(' ');
+        auto column_colon = text.rfind(':');
+        auto line_colon = column_colon == std::string::npos || column_colon == 0 ? std::string::npos : text.rfind(':', column_colon - 1);
+
+        if (space == std::string::npos || line_colon == std::string::npos || line_colon <= space) {
+            throw std::runtime_error("Map line " + std::to_string(number) + ": Expected '<address> <file>:<line>:<column>'");
+        }
+
+        int address = (int)std::stol(text.substr(0, space), nullptr, 0);
+        std::string path = text.substr(space + 1, line_colon - space - 1);
+        size_t line_number = std::stoul(text.substr(line_colon + 1, column_colon - line_colon - 1));
+
+        if (address < 0 || address >= s_memory_size) {
+            throw std::runtime_error("Map line " + std::to_string(number) + ": Address outside of memory");
+        }
+
+        auto file = std::find_if(files.begin(), files.end(), [&](const SourceFile &file) { return file.path == path; });
+        if (file == files.end()) {
+            files.push_back({path, {}});
+            file = files.end() - 1;
+        }
+
+        SourceLine &line = file->lines[line_number];
+        line.has_code = true;
+
+        // A word is counted once, even if the map were to list it twice
+        if (!attributed[address]) {
+            attributed[address] = true;
+            line.executions += profile.executions[address];
+            line.cycles += profile.cycles[address];
+            line.runs = std::max(line.runs, profile.executions[address]);
+        }
+    }
+
+    unattributed = 0;
+    for (int address = 0; address < s_memory_size; address++) {
+        if (!attributed[address]) {
+            unattributed += profile.cycles[address];
+        }
+    }
+
+    return files;
+}
+
+static std::vector<std::string> read_lines(const std::string &path) {
+    std::ifstream stream(path);
+    std::vector<std::string> lines;
+    std::string line;
+
+    while (std::getline(stream, line)) {
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+static std::string bar(uint64_t cycles, uint64_t total) {
+    return std::string(total ? (size_t)((cycles * s_bar_width + total / 2) / total) : 0, '#');
+}
+
+static void print_percentage(uint64_t cycles, uint64_t total) {
+    std::cout << std::right << std::setw(6) << std::fixed << std::setprecision(1) << (total ? 100.0 * cycles / total : 0.0) << "%";
+}
+
+// Every line of each source with the share of the cycles as a bar, then the hottest lines by cycles
+static void report(const std::vector<SourceFile> &files, const Profile &profile, uint64_t unattributed, size_t top) {
+    uint64_t total = 0;
+    for (auto cycles : profile.cycles) {
+        total += cycles;
+    }
+
+    std::cout << profile.steps << " instructions, " << total << " cycles (" << s_instruction_cycles << " per instruction, "
+              << s_instruction_cycles + s_indirect_cycles << " for LDIV and STIV)" << std::endl;
+
+    struct Hot {
+        const std::string *path;
+        size_t line;
+        const SourceLine *profile;
+        std::string text;
+    };
+    std::vector<Hot> hottest;
+
+    for (const auto &file : files) {
+        auto source = read_lines(file.path);
+        size_t line_count = std::max(source.size(), file.lines.empty() ? 0 : file.lines.rbegin()->first);
+
+        std::cout << std::endl << file.path << std::endl;
+        std::cout << std::right << std::setw(12) << "cycles" << std::setw(7) << "%" << "  " << std::left
+                  << std::setw(s_bar_width) << "" << std::right << std::setw(12) << "instructions" << std::setw(10) << "runs"
+                  << std::setw(7) << "line" << std::endl;
+
+        for (size_t number = 1; number <= line_count; number++) {
+            std::string text = number <= source.size() ? source[number - 1] : "";
+            auto line = file.lines.find(number);
+
+            if (line == file.lines.end()) {
+                std::cout << std::setw(12 + 7 + 2 + s_bar_width + 12 + 10) << "" << std::right << std::setw(7) << number
+                          << "  " << text << std::endl;
+                continue;
+            }
+
+            const SourceLine &profile_line = line->second;
+            std::cout << std::right << std::setw(12) << profile_line.cycles;
+            print_percentage(profile_line.cycles, total);
+            std::cout << "  " << std::left << std::setw(s_bar_width) << bar(profile_line.cycles, total) << std::right
+                      << std::setw(12) << profile_line.executions << std::setw(10) << profile_line.runs << std::setw(7)
+                      << number << "  " << text << std::endl;
+
+            if (profile_line.cycles > 0) {
+                hottest.push_back({&file.path, number, &profile_line, text});
+            }
+        }
+    }
+
+    std::cout << std::endl << std::right << std::setw(12) << unattributed;
+    print_percentage(unattributed, total);
+    std::cout << "  outside of any statement (HALT, constants, registers)" << std::endl;
+
+    std::stable_sort(hottest.begin(), hottest.end(), [](const Hot &a, const Hot &b) {
+        return a.profile->cycles > b.profile->cycles;
+    });
+
+    if (hottest.size() > top) {
+        hottest.resize(top);
+    }
+
+    std::cout << std::endl << "Hottest lines:" << std::endl;
+    for (const auto &hot : hottest) {
+        auto begin = hot.text.find_first_not_of(" \t");
+        std::cout << std::right << std::setw(12) << hot.profile->cycles;
+        print_percentage(hot.profile->cycles, total);
+        std::cout << "  " << *hot.path << ":" << hot.line << "  " << (begin == std::string::npos ? "" : hot.text.substr(begin))
+                  << std::endl;
+    }
+}
+
+static void usage(const char *program) {
+    std::cerr << "Usage: " << program << " [--steps <limit>] [--top <lines>] <assembly> [<map>]" << std::endl;
+    std::cerr << "The map defaults to <assembly>.map, as written by MIMA_Compiler --source-map" << std::endl;
+    exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t step_limit = 100'000'000;
+    size_t top = 5;
+    std::vector<const char *> positional;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view argument(argv[i]);
+
+        if (argument == "--steps" && i + 1 < argc) {
+            step_limit = std::stoull(argv[++i]);
+        } else if (argument == "--top" && i + 1 < argc) {
+            top = std::stoul(argv[++i]);
+        } else if (argument.starts_with("-")) {
+            usage(argv[0]);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.empty() || positional.size() > 2) {
+        usage(argv[0]);
+    }
+
+    std::string assembly_path = positional[0];
+    std::string map_path = positional.size() > 1 ? positional[1] : assembly_path + ".map";
+
+    std::ifstream assembly(assembly_path);
+    if (!assembly) {
+        std::cerr << assembly_path << ": Could not read file" << std::endl;
+        exit(-1);
+    }
+
+    std::ifstream map(map_path);
+    if (!map) {
+        std::cerr << map_path << ": Could not read file" << std::endl;
+        exit(-1);
+    }
+
+    try {
+        Program program = assemble(assembly);
+        Profile profile = run(program, step_limit);
+
+        uint64_t unattributed;
+        auto files = attribute(map, profile, unattributed);
+        report(files, profile, unattributed, top);
+    } catch (const std::exception &error) {
+        std::cerr << error.what() << std::endl;
+        exit(-1);
+    }
+
+    return 0;
+}
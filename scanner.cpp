@@ -0,0 +1,170 @@
+#include "scanner.h"
+
+#include <array>
+#include <bit>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define MIMA_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+static constexpr uint8_t class_bit(CharacterClass character_class) {
+    return 1 << static_cast<int>(character_class);
+}
+
+static constexpr std::array<uint8_t, 256> make_class_table() {
+    std::array<uint8_t, 256> table{};
+
+    for (int c = 0; c < 256; c++) {
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        bool digit = c >= '0' && c <= '9';
+
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            table[c] |= class_bit(CharacterClass::Space);
+        }
+        if (letter || digit || c == '_' || c == '-') {
+            table[c] |= class_bit(CharacterClass::IdentifierBody);
+        }
+        if (digit) {
+            table[c] |= class_bit(CharacterClass::Digit);
+        }
+        if (c != '\n' && c != '\r') {
+            table[c] |= class_bit(CharacterClass::CommentBody);
+        }
+    }
+
+    return table;
+}
+
+static constexpr std::array<uint8_t, 256> s_class_table = make_class_table();
+
+static size_t scan_scalar(CharacterClass character_class, const char *begin, const char *end) {
+    uint8_t mask = class_bit(character_class);
+    const char *position = begin;
+
+    while (position < end && (s_class_table[static_cast<unsigned char>(*position)] & mask)) {
+        position++;
+    }
+
+    return position - begin;
+}
+
+#ifdef MIMA_SCANNER_X86
+
+// Bytes in [low, low + count) as 0xFF, compared unsigned through the minimum
+static __m128i in_range_sse2(__m128i bytes, char low, char count) {
+    __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(static_cast<char>(count - 1))), offset);
+}
+
+static __m128i classify_sse2(CharacterClass character_class, __m128i bytes) {
+    switch (character_class) {
+        case CharacterClass::Space:
+            return _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), in_range_sse2(bytes, '\t', 5));
+        case CharacterClass::IdentifierBody: {
+            // Setting bit 5 maps upper to lower case letters without moving anything else into a-z
+            __m128i letter = in_range_sse2(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 26);
+            __m128i symbol = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('-')));
+            return _mm_or_si128(_mm_or_si128(letter, in_range_sse2(bytes, '0', 10)), symbol);
+        }
+        case CharacterClass::Digit:
+            return in_range_sse2(bytes, '0', 10);
+        case CharacterClass::CommentBody:
+        default: {
+            __m128i line_break = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+            return _mm_xor_si128(line_break, _mm_set1_epi8(-1));
+        }
+    }
+}
+
+static size_t scan_sse2(CharacterClass character_class, const char *begin, const char *end) {
+    const char *position = begin;
+
+    while (end - position >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position));
+        auto outside = ~static_cast<unsigned>(_mm_movemask_epi8(classify_sse2(character_class, bytes))) & 0xFFFF;
+
+        if (outside) {
+            return position - begin + std::countr_zero(outside);
+        }
+
+        position += 16;
+    }
+
+    return position - begin + scan_scalar(character_class, position, end);
+}
+
+__attribute__((target("avx2")))
+static __m256i in_range_avx2(__m256i bytes, char low, char count) {
+    __m256i offset = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(static_cast<char>(count - 1))), offset);
+}
+
+__attribute__((target("avx2")))
+static __m256i classify_avx2(CharacterClass character_class, __m256i bytes) {
+    switch (character_class) {
+        case CharacterClass::Space:
+            return _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), in_range_avx2(bytes, '\t', 5));
+        case CharacterClass::IdentifierBody: {
+            __m256i letter = in_range_avx2(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 26);
+            __m256i symbol = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')),
+                                             _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('-')));
+            return _mm256_or_si256(_mm256_or_si256(letter, in_range_avx2(bytes, '0', 10)), symbol);
+        }
+        case CharacterClass::Digit:
+            return in_range_avx2(bytes, '0', 10);
+        case CharacterClass::CommentBody:
+        default: {
+            __m256i line_break = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                                                 _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')));
+            return _mm256_xor_si256(line_break, _mm256_set1_epi8(-1));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(CharacterClass character_class, const char *begin, const char *end) {
+    const char *position = begin;
+
+    while (end - position >= 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(position));
+        auto outside = ~static_cast<unsigned>(_mm256_movemask_epi8(classify_avx2(character_class, bytes)));
+
+        if (outside) {
+            return position - begin + std::countr_zero(outside);
+        }
+
+        position += 32;
+    }
+
+    return position - begin + scan_sse2(character_class, position, end);
+}
+
+#endif
+
+ScanLevel supported_scan_level() {
+#ifdef MIMA_SCANNER_X86
+    static const ScanLevel level = __builtin_cpu_supports("avx2") ? ScanLevel::AVX2 : ScanLevel::SSE2;
+    return level;
+#else
+    return ScanLevel::Scalar;
+#endif
+}
+
+size_t scan_run(CharacterClass character_class, const char *begin, const char *end) {
+    static const ScanLevel level = supported_scan_level();
+    return scan_run(character_class, begin, end, level);
+}
+
+size_t scan_run(CharacterClass character_class, const char *begin, const char *end, ScanLevel level) {
+    switch (level) {
+#ifdef MIMA_SCANNER_X86
+        case ScanLevel::AVX2:
+            return scan_avx2(character_class, begin, end);
+        case ScanLevel::SSE2:
+            return scan_sse2(character_class, begin, end);
+#endif
+        default:
+            return scan_scalar(character_class, begin, end);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef MIMA_COMPILER_SCANNER_H
+#define MIMA_COMPILER_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Characters the lexer skips over in runs, most of the input bytes are in one of them
+enum class CharacterClass : uint8_t {
+    // ' ', '\t', '\n', '\v', '\f' and '\r' like \s
+    Space,
+    // [a-zA-Z0-9_\-]
+    IdentifierBody,
+    // [0-9]
+    Digit,
+    // Anything but a line break, like . in a regex
+    CommentBody,
+};
+
+// Instruction sets a run can be scanned with, 16 or 32 bytes are classified at once with SSE2 or AVX2
+enum class ScanLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// Best level of the CPU the compiler runs on
+ScanLevel supported_scan_level();
+
+// Number of characters of the class at the start of [begin, end)
+size_t scan_run(CharacterClass character_class, const char *begin, const char *end);
+
+// Same with an explicit level, which has to be supported
+size_t scan_run(CharacterClass character_class, const char *begin, const char *end, ScanLevel level);
+
+#endif //MIMA_COMPILER_SCANNER_H
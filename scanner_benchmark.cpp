@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "allocations.h"
+#include "scanner.h"
+
+// Throughput of scan_run at every level the CPU supports, on input made of runs of one class separated by single
+// characters of another one, like the lexer steps over it.
+// Usage: MIMA_Scanner_Benchmark [--mem-report] [<megabytes>]
+
+struct Input {
+    const char *name;
+    CharacterClass character_class;
+    std::string text;
+};
+
+static std::string make_runs(size_t size, const std::string &run_characters, char separator, size_t max_run) {
+    std::mt19937 random(42);
+    std::uniform_int_distribution<size_t> length(1, max_run);
+    std::uniform_int_distribution<size_t> character(0, run_characters.size() - 1);
+    std::string text;
+    text.reserve(size + max_run + 1);
+
+    while (text.size() < size) {
+        for (size_t i = length(random); i > 0; i--) {
+            text += run_characters[character(random)];
+        }
+        text += separator;
+    }
+
+    return text;
+}
+
+static const char *level_name(ScanLevel level) {
+    switch (level) {
+        case ScanLevel::AVX2: return "avx2";
+        case ScanLevel::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// Skips every run and its separator, the sum of the run lengths guards against the loop being optimized out
+static size_t scan(const Input &input, ScanLevel level) {
+    const char *position = input.text.data();
+    const char *end = position + input.text.size();
+    size_t total = 0;
+
+    while (position < end) {
+        size_t length = scan_run(input.character_class, position, end, level);
+        total += length;
+        position += length + 1;
+    }
+
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    bool memory_report = argc > 1 && std::string_view(argv[1]) == "--mem-report";
+    if (memory_report) {
+#ifndef MIMA_ALLOCATION_TRACKING
+        std::cerr << "--mem-report: Configure with -DMIMA_ALLOCATION_TRACKING=ON to count allocations" << std::endl;
+        return -1;
+#endif
+        enable_allocation_tracking();
+        argc--;
+        argv++;
+    }
+
+    size_t size = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64) << 20;
+
+    std::vector<Input> inputs;
+    {
+        AllocationPhase phase("inputs");
+        inputs = {
+            {"whitespace", CharacterClass::Space, make_runs(size, " \t\n", 'a', 64)},
+            {"identifiers", CharacterClass::IdentifierBody, make_runs(size, "abcdefghijklmnopqrstuvwxyz_0123456789", ' ', 24)},
+            {"digits", CharacterClass::Digit, make_runs(size, "0123456789", ';', 10)},
+            {"comments", CharacterClass::CommentBody, make_runs(size, "abc def, ghi = 12; ", '\n', 80)},
+        };
+    }
+
+    std::vector<ScanLevel> levels{ScanLevel::Scalar};
+    if (supported_scan_level() >= ScanLevel::SSE2) {
+        levels.push_back(ScanLevel::SSE2);
+    }
+    if (supported_scan_level() >= ScanLevel::AVX2) {
+        levels.push_back(ScanLevel::AVX2);
+    }
+
+    int status = 0;
+
+    for (const auto &input : inputs) {
+        size_t expected = scan(input, ScanLevel::Scalar);
+
+        for (auto level : levels) {
+            AllocationPhase phase("scan");
+            auto start = std::chrono::steady_clock::now();
+            size_t total = scan(input, level);
+            std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+            std::cout << std::left << std::setw(12) << input.name << std::setw(8) << level_name(level) << std::right
+                      << std::setw(10) << std::fixed << std::setprecision(1) << input.text.size() / time.count() / (1 << 20)
+                      << " MiB/s";
+
+            if (total != expected) {
+                std::cout << "  mismatch: " << total << " instead of " << expected;
+                status = 1;
+            }
+
+            std::cout << std::endl;
+        }
+    }
+
+    if (memory_report) {
+        report_allocations(std::cerr);
+    }
+
+    return status;
+}
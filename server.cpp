@@ -0,0 +1,363 @@
+#include "server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <system_error>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+// Larger requests are rejected before anything is allocated for them
+static const size_t s_max_request_size = 64 * 1024 * 1024;
+static const size_t s_max_header_size = 64;
+
+// Buffered reader and writer for one client. The buffers are kept between requests.
+class Connection {
+public:
+    Connection(int input, int output)
+        : m_input(input)
+        , m_output(output)
+        , m_buffer(64 * 1024)
+    { }
+
+    std::optional<std::string_view> read_line(size_t max_length);
+    bool read(std::string &data, size_t length);
+    bool write(const std::string &data) const;
+
+private:
+    bool fill();
+
+    int m_input;
+    int m_output;
+    std::vector<char> m_buffer;
+    size_t m_begin{0};
+    size_t m_end{0};
+    std::string m_line;
+};
+
+bool Connection::fill() {
+    m_begin = 0;
+    m_end = 0;
+
+    while (true) {
+        ssize_t count = ::read(m_input, m_buffer.data(), m_buffer.size());
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count <= 0) {
+            return false;
+        }
+
+        m_end = count;
+        return true;
+    }
+}
+
+std::optional<std::string_view> Connection::read_line(size_t max_length) {
+    m_line.clear();
+
+    while (m_line.size() <= max_length) {
+        if (m_begin == m_end && !fill()) {
+            return std::nullopt;
+        }
+
+        char c = m_buffer[m_begin++];
+        if (c == '\n') {
+            return m_line;
+        }
+
+        m_line += c;
+    }
+
+    return std::nullopt;
+}
+
+bool Connection::read(std::string &data, size_t length) {
+    data.clear();
+
+    while (data.size() < length) {
+        if (m_begin == m_end && !fill()) {
+            return false;
+        }
+
+        size_t count = std::min(length - data.size(), m_end - m_begin);
+        data.append(m_buffer.data() + m_begin, count);
+        m_begin += count;
+    }
+
+    return true;
+}
+
+bool Connection::write(const std::string &data) const {
+    size_t written = 0;
+
+    while (written < data.size()) {
+        ssize_t count = ::write(m_output, data.data() + written, data.size() - written);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count <= 0) {
+            return false;
+        }
+
+        written += count;
+    }
+
+    return true;
+}
+
+static bool parse_size(std::string_view &text, size_t &value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end == text.data()) {
+        return false;
+    }
+
+    text.remove_prefix(end - text.data());
+    return true;
+}
+
+// Decimal or 0x prefixed hexadecimal number
+static std::optional<int> parse_number(std::string_view text) {
+    int base = 10;
+
+    if (text.starts_with("0x")) {
+        text.remove_prefix(2);
+        base = 16;
+    }
+
+    int number;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number, base);
+
+    if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+        return std::nullopt;
+    }
+
+    return number;
+}
+
+// Level of an "optimization" option, 0, 1, 2 or s like the -O flags
+static std::optional<mima::OptimizationLevel> parse_optimization(std::string_view text) {
+    if (text == "0") {
+        return mima::OptimizationLevel::O0;
+    } else if (text == "1") {
+        return mima::OptimizationLevel::O1;
+    } else if (text == "2") {
+        return mima::OptimizationLevel::O2;
+    } else if (text == "s") {
+        return mima::OptimizationLevel::Os;
+    }
+
+    return std::nullopt;
+}
+
+// Applies the "<key>=<value>" lines of a request, unknown keys are reported as diagnostics
+static bool apply_options(std::string_view text, mima::Options &options, mima::Result &result) {
+    while (!text.empty()) {
+        auto line = text.substr(0, text.find('\n'));
+        text.remove_prefix(std::min(text.size(), line.size() + 1));
+
+        if (line.empty()) {
+            continue;
+        }
+
+        auto separator = line.find('=');
+        auto key = line.substr(0, separator);
+        auto value = separator == std::string_view::npos ? std::string_view() : line.substr(separator + 1);
+
+        std::optional<int> *number = nullptr;
+        if (key == "stack-base") {
+            number = &options.stack_base;
+        } else if (key == "stack-size") {
+            number = &options.stack_size;
+        }
+
+        mima::Diagnostic diagnostic;
+
+        if (key == "optimization") {
+            auto level = parse_optimization(value);
+            if (level) {
+                options.optimization = *level;
+                continue;
+            }
+
+            diagnostic.message = "Invalid value '" + std::string(value) + "' for option '" + std::string(key) + "'";
+        } else if (!number) {
+            diagnostic.message = "Unknown option '" + std::string(key) + "'";
+        } else if (!(*number = parse_number(value))) {
+            diagnostic.message = "Invalid value '" + std::string(value) + "' for option '" + std::string(key) + "'";
+        } else {
+            continue;
+        }
+
+        result.diagnostics.push_back(diagnostic);
+    }
+
+    return result.diagnostics.empty();
+}
+
+static void format_response(const mima::Result &result, std::string &response) {
+    if (result.success) {
+        response = "ok " + std::to_string(result.assembly.size()) + "\n";
+        response += result.assembly;
+        return;
+    }
+
+    std::string body;
+    for (const auto &diagnostic : result.diagnostics) {
+        body += std::to_string(diagnostic.line) + ":" + std::to_string(diagnostic.column) + ": " + diagnostic.message + "\n";
+    }
+
+    response = "error " + std::to_string(body.size()) + "\n";
+    response += body;
+}
+
+CompileServer::CompileServer(mima::Options defaults, size_t thread_count)
+    : m_defaults(defaults)
+    , m_thread_count(thread_count)
+{ }
+
+void CompileServer::serve(int input, int output) const {
+    Connection connection(input, output);
+    std::string options;
+    std::string source;
+    std::string response;
+
+    while (true) {
+        auto header = connection.read_line(s_max_header_size);
+        if (!header) {
+            return;
+        }
+
+        size_t options_size, source_size;
+        bool valid = parse_size(*header, options_size) && header->starts_with(" ");
+
+        if (valid) {
+            header->remove_prefix(1);
+            valid = parse_size(*header, source_size) && header->empty();
+        }
+
+        if (!valid || options_size > s_max_request_size || source_size > s_max_request_size) {
+            mima::Result result;
+            result.diagnostics.push_back({.message = "Malformed request header"});
+            format_response(result, response);
+            connection.write(response);
+            return;
+        }
+
+        if (!connection.read(options, options_size) || !connection.read(source, source_size)) {
+            return;
+        }
+
+        mima::Options compile_options = m_defaults;
+        mima::Result result;
+
+        // A request that fails in an unforeseen way only fails itself, the server keeps answering
+        try {
+            if (apply_options(options, compile_options, result)) {
+                result = mima::compile(source, compile_options);
+            }
+        } catch (const std::exception &error) {
+            result = {};
+            result.diagnostics.push_back({.message = std::string("Internal error: ") + error.what()});
+        }
+
+        format_response(result, response);
+
+        if (!connection.write(response)) {
+            return;
+        }
+    }
+}
+
+// Removes the socket file left behind by a server that did not shut down. A socket that still accepts connections
+// belongs to a running server and anything else is not ours to remove, binding then fails with EADDRINUSE.
+static void remove_stale_socket(const std::string &path, const sockaddr_un &address) {
+    struct stat status{};
+    if (lstat(path.c_str(), &status) < 0 || !S_ISSOCK(status.st_mode)) {
+        return;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return;
+    }
+
+    bool stale = connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0 && errno == ECONNREFUSED;
+    ::close(probe);
+
+    if (stale) {
+        ::unlink(path.c_str());
+    }
+}
+
+void CompileServer::listen(const std::string &path) const {
+    // A client closing its connection early must not terminate the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::system_error(std::make_error_code(std::errc::filename_too_long), path);
+    }
+
+    std::strcpy(address.sun_path, path.c_str());
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+
+    remove_stale_socket(path, address);
+
+    if (bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(server, SOMAXCONN) < 0) {
+        int error = errno;
+        ::close(server);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+
+    // Every worker accepts on the shared socket and serves the connection itself. The first accept that fails for
+    // good shuts the socket down, which wakes the other workers, and is reported once all of them are done.
+    std::atomic<int> failure{0};
+    std::vector<std::function<void()>> workers(std::max(m_thread_count, (size_t)1), [&] {
+        while (failure == 0) {
+            int client = accept(server, nullptr, nullptr);
+
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+
+                int expected = 0;
+                if (failure.compare_exchange_strong(expected, errno)) {
+                    shutdown(server, SHUT_RDWR);
+                }
+                return;
+            }
+
+            serve(client, client);
+            ::close(client);
+        }
+    });
+
+    ThreadPool(workers.size()).run(std::move(workers));
+
+    ::close(server);
+    throw std::system_error(failure, std::generic_category(), "accept");
+}
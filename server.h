@@ -0,0 +1,30 @@
+#ifndef MIMA_COMPILER_SERVER_H
+#define MIMA_COMPILER_SERVER_H
+
+#include <cstddef>
+#include <string>
+
+#include "mima.h"
+
+// Keeps the compiler resident and answers length prefixed requests, so a compilation costs no process start.
+// A request is "<options length> <source length>\n" followed by the options ("<key>=<value>" lines) and the source.
+// The response is "ok <length>\n" followed by the assembly or "error <length>\n" followed by one
+// "<line>:<column>: <message>" line per diagnostic.
+class CompileServer {
+public:
+    // The options of a request start out as the defaults, usually the ones given on the command line
+    CompileServer(mima::Options defaults, size_t thread_count);
+
+    // Answers requests until the input is closed or a request is malformed
+    void serve(int input, int output) const;
+
+    // Accepts connections on a Unix domain socket, serving up to thread_count of them at once. Further connections
+    // wait in the backlog until one closes. A stale socket file of a dead server is replaced. Throws std::system_error.
+    [[noreturn]] void listen(const std::string &path) const;
+
+private:
+    mima::Options m_defaults;
+    size_t m_thread_count;
+};
+
+#endif //MIMA_COMPILER_SERVER_H
@@ -0,0 +1,225 @@
+#include "simulator.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+static const int s_word_mask = 0xFFFFFF;
+static const int s_address_mask = 0xFFFFF;
+static const int s_sign = 0x800000;
+
+struct Mnemonic {
+    std::string_view name;
+    int opcode;
+};
+
+// Opcodes up to 0xB take a 20 bit operand, the extended ones 0xF0 - 0xF2 none
+static const Mnemonic s_mnemonics[] = {
+    {"LDC", 0x0}, {"LDV", 0x1}, {"STV", 0x2}, {"ADD", 0x3}, {"AND", 0x4}, {"OR", 0x5}, {"XOR", 0x6}, {"EQL", 0x7},
+    {"JMP", 0x8}, {"JMN", 0x9}, {"LDIV", 0xA}, {"STIV", 0xB}, {"HALT", 0xF0}, {"NOT", 0xF1}, {"RAR", 0xF2},
+};
+
+static const Mnemonic *find_mnemonic(std::string_view name) {
+    for (const auto &mnemonic : s_mnemonics) {
+        if (mnemonic.name == name) {
+            return &mnemonic;
+        }
+    }
+
+    return nullptr;
+}
+
+static bool is_instruction(std::string_view name) {
+    return name == "DS" || name == "=" || find_mnemonic(name);
+}
+
+// A line of the assembly without its comment
+struct AssemblyLine {
+    std::string label;
+    std::string instruction;
+    std::string operand;
+    size_t number;
+};
+
+// Streamed assembly separates the columns by tabs, aligned assembly pads them with spaces
+static std::vector<std::string> split_fields(std::string_view text) {
+    std::vector<std::string> fields;
+    bool tabbed = text.find('\t') != std::string_view::npos;
+    std::string field;
+
+    for (char c : text) {
+        if (tabbed ? c == '\t' : c == ' ') {
+            if (tabbed || !field.empty()) {
+                fields.push_back(std::move(field));
+                field.clear();
+            }
+        } else if (c != '\r' && (tabbed ? c != ' ' : true)) {
+            field += c;
+        }
+    }
+
+    if (!field.empty()) {
+        fields.push_back(std::move(field));
+    }
+
+    // An aligned line only has a label column if it starts with one
+    if (!tabbed && !fields.empty() && (fields.size() == 1 || !is_instruction(fields[1]))) {
+        fields.insert(fields.begin(), "");
+    }
+
+    fields.resize(3);
+    return fields;
+}
+
+static std::vector<AssemblyLine> read_assembly(std::istream &stream) {
+    std::vector<AssemblyLine> lines;
+    std::string text;
+
+    for (size_t number = 1; std::getline(stream, text); number++) {
+        auto fields = split_fields(std::string_view(text).substr(0, text.find(';')));
+
+        if (!fields[1].empty()) {
+            lines.push_back({fields[0], fields[1], fields[2], number});
+        }
+    }
+
+    return lines;
+}
+
+static int operand_value(const AssemblyLine &line, const std::unordered_map<std::string, int> &labels) {
+    const std::string &operand = line.operand;
+
+    if (operand.empty()) {
+        return 0;
+    } else if (isdigit((unsigned char)operand.front()) || operand.front() == '-') {
+        return (int)std::stol(operand, nullptr, 0);
+    }
+
+    // "<label>+<offset>" addresses an array element
+    auto plus = operand.find('+');
+    auto label = labels.find(operand.substr(0, plus));
+    if (label == labels.end()) {
+        throw std::runtime_error("Line " + std::to_string(line.number) + ": Unknown label '" + operand + "'");
+    }
+
+    return label->second + (plus == std::string::npos ? 0 : (int)std::stol(operand.substr(plus + 1), nullptr, 0));
+}
+
+// Places the words like the compiler counted them, "* = <address>" continues at the given address
+static Program assemble_lines(const std::vector<AssemblyLine> &lines) {
+    Program program;
+    auto &labels = program.labels;
+    int address = 0;
+
+    for (const auto &line : lines) {
+        if (line.instruction == "=") {
+            address = (int)std::stol(line.operand, nullptr, 0);
+            continue;
+        }
+
+        if (!line.label.empty()) {
+            labels[line.label] = address;
+        }
+        address++;
+    }
+
+    program.memory.resize(s_memory_size);
+    address = 0;
+
+    for (const auto &line : lines) {
+        if (line.instruction == "=") {
+            address = (int)std::stol(line.operand, nullptr, 0);
+            continue;
+        }
+
+        if (address < 0 || address >= s_memory_size) {
+            throw std::runtime_error("Line " + std::to_string(line.number) + ": Address outside of memory");
+        }
+
+        int value = operand_value(line, labels);
+
+        if (line.instruction == "DS") {
+            program.memory[address] = value & s_word_mask;
+        } else if (auto mnemonic = find_mnemonic(line.instruction)) {
+            program.memory[address] = mnemonic->opcode > 0xF ? mnemonic->opcode << 16 : mnemonic->opcode << 20 | (value & s_address_mask);
+
+            if (program.start < 0) {
+                program.start = address;
+            }
+        } else {
+            throw std::runtime_error("Line " + std::to_string(line.number) + ": Unknown instruction '" + line.instruction + "'");
+        }
+
+        address++;
+    }
+
+    if (program.start < 0) {
+        throw std::runtime_error("The program has no instructions");
+    }
+
+    return program;
+}
+
+Program assemble(std::istream &assembly) {
+    return assemble_lines(read_assembly(assembly));
+}
+
+static std::runtime_error invalid_instruction(int word, int address) {
+    std::ostringstream message;
+    message << std::hex << std::uppercase << "Invalid instruction 0x" << word << " at 0x" << address;
+    return std::runtime_error(message.str());
+}
+
+Profile run(Program &program, uint64_t step_limit) {
+    std::vector<int> &memory = program.memory;
+    Profile profile;
+    profile.executions.resize(s_memory_size);
+    profile.cycles.resize(s_memory_size);
+
+    int akku = 0;
+    int counter = program.start;
+
+    while (true) {
+        if (profile.steps++ == step_limit) {
+            throw std::runtime_error("No HALT after " + std::to_string(step_limit) + " instructions");
+        }
+
+        int address = counter;
+        int word = memory[address];
+        int operand = word & s_address_mask;
+        counter = (counter + 1) & s_address_mask;
+
+        profile.executions[address]++;
+        profile.cycles[address] += s_instruction_cycles;
+
+        switch (word >> 20) {
+            case 0x0: akku = operand; break;
+            case 0x1: akku = memory[operand]; break;
+            case 0x2: memory[operand] = akku; break;
+            case 0x3: akku = (akku + memory[operand]) & s_word_mask; break;
+            case 0x4: akku &= memory[operand]; break;
+            case 0x5: akku |= memory[operand]; break;
+            case 0x6: akku ^= memory[operand]; break;
+            case 0x7: akku = akku == memory[operand] ? s_word_mask : 0; break;
+            case 0x8: counter = operand; break;
+            case 0x9: counter = akku & s_sign ? operand : counter; break;
+            case 0xA:
+                akku = memory[memory[operand] & s_address_mask];
+                profile.cycles[address] += s_indirect_cycles;
+                break;
+            case 0xB:
+                memory[memory[operand] & s_address_mask] = akku;
+                profile.cycles[address] += s_indirect_cycles;
+                break;
+            case 0xF:
+                switch (word >> 16) {
+                    case 0xF0: return profile;
+                    case 0xF1: akku = ~akku & s_word_mask; break;
+                    case 0xF2: akku = (akku >> 1 | (akku & 1) << 23) & s_word_mask; break;
+                    default: throw invalid_instruction(word, address);
+                }
+                break;
+            default: throw invalid_instruction(word, address);
+        }
+    }
+}
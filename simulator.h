@@ -0,0 +1,39 @@
+#ifndef MIMA_COMPILER_SIMULATOR_H
+#define MIMA_COMPILER_SIMULATOR_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Assembler and simulator of the MiMa for the output of the compiler, aligned or streamed and with origins
+
+static const int s_memory_size = 1 << 20;
+
+// Cycle model: every instruction takes 12 clock cycles including its fetch, LDIV and STIV access memory a second time
+static const uint64_t s_instruction_cycles = 12;
+static const uint64_t s_indirect_cycles = 3;
+
+// The memory image, the address of every label and the first instruction
+struct Program {
+    std::vector<int> memory;
+    std::unordered_map<std::string, int> labels;
+    int start{-1};
+};
+
+// Number of times each word was executed and the cycles it took, by address
+struct Profile {
+    std::vector<uint64_t> executions;
+    std::vector<uint64_t> cycles;
+    uint64_t steps{0};
+};
+
+// Throws std::runtime_error on lines it cannot assemble
+Program assemble(std::istream &assembly);
+
+// Runs from the first instruction, which skips the registers and variables declared in front of the program, until HALT.
+// Throws std::runtime_error on an invalid instruction or once the step limit is reached.
+Profile run(Program &program, uint64_t step_limit);
+
+#endif //MIMA_COMPILER_SIMULATOR_H
@@ -0,0 +1,278 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mima.h"
+#include "simulator.h"
+
+// Compiles small programs at every optimization level in both formats, runs them on the simulator and checks the
+// variables they leave behind, so a level can not change what a program computes. Invalid programs have to be
+// reported as diagnostics at the right position. Run by ctest.
+
+struct Expectation {
+    const char *variable;
+    int value;
+};
+
+struct ProgramCase {
+    const char *name;
+    const char *source;
+    std::vector<Expectation> expected;
+};
+
+static const ProgramCase s_programs[] = {
+    // Loads of a value AKKU still holds are dropped, but nothing is assumed across a label
+    {"accumulator tracking",
+     "var a = 5; var b = 20; var c; var d; var e;\n"
+     "c = a; d = c + a; c = d + c; a = c; c = a + d;\n"
+     "if (a < b) { e = c; } else { e = d; }\n"
+     "d = e + 1;\n"
+     "while (a < b) { a = a + 1; b = b - 1; }\n"
+     "e = a; a = b; b = e;\n",
+     {{"a", 17}, {"b", 18}, {"c", 25}, {"d", 26}, {"e", 18}}},
+    // Literals beyond the 20 bit operand of LDC are loaded from one pool cell per value
+    {"constant pool",
+     "var a; var b; var c; var d; var e;\n"
+     "a = 0x123456; b = 0x123456 + a; c = -0x54321; d = 0xFFFFF; e = 0x800000 + 0x100000;\n",
+     {{"a", 0x123456}, {"b", 0x2468AC}, {"c", -0x54321}, {"d", 0xFFFFF}, {"e", -0x700000}}},
+    // Constant factors go through addition chains, / and % by powers of two treat the dividend as unsigned
+    {"multiplication, division and modulo",
+     "var a = 7; var b = 0; var x = 100; var p; var q; var r; var s; var t; var u; var v; var w; var y;\n"
+     "b = b - 3;\n"
+     "p = a * b; q = a * 10; r = b * 5; s = a * 0; y = a * a * x;\n"
+     "t = x / 8; u = x % 8; v = b / 2; w = b % 4;\n",
+     {{"p", -21}, {"q", 70}, {"r", -15}, {"s", 0}, {"y", 4900}, {"t", 12}, {"u", 4}, {"v", 0x7FFFFE}, {"w", 1}}},
+    // A count of 0x800000 or more is negative as a 24 bit word and shifts nothing
+    {"shift by a wrapped count",
+     "var x = 0x123456; var c = 0xd63605; var y; var z; var w; var u;\n"
+     "y = x >> 0xd63605;\n"
+     "z = 0x123456 >> 0x800000;\n"
+     "w = x >> c;\n"
+     "u = x >> -3;\n",
+     {{"y", 0x123456}, {"z", 0x123456}, {"w", 0x123456}, {"u", 0x123456}}},
+    // Comparisons with a constant become sign and zero tests, also with the constant on the left or a masked group
+    {"sign and zero comparisons",
+     "var x; var lt = 0; var gt = 0; var le = 0; var ge = 0; var eq = 0; var ne = 0; var z = 0; var m = 0; var k = 0;\n"
+     "x = 0 - 3;\n"
+     "while (x < 4) {\n"
+     "  if (x < 0) { lt = lt + 1; }\n"
+     "  if (0 < x) { gt = gt + 1; }\n"
+     "  if (x <= 1) { le = le + 1; }\n"
+     "  if (0 >= x) { ge = ge + 1; }\n"
+     "  if (0 == x) { eq = eq + 1; }\n"
+     "  if (x != 0) { ne = ne + 1; }\n"
+     "  if ((x & 1) == 0) { z = z + 1; }\n"
+     "  if ((x & 3) + 1 > 2) { m = m + 1; }\n"
+     "  if (x & 2 != 0 && !(0 != x % 2)) { k = k + 1; }\n"
+     "  x = x + 1;\n"
+     "}\n",
+     {{"lt", 3}, {"gt", 3}, {"le", 5}, {"ge", 4}, {"eq", 1}, {"ne", 6}, {"z", 3}, {"m", 4}, {"k", 2}, {"x", 4}}},
+    // Dense cases index a jump table, also below zero and with gaps, sparse ones are found by a binary search
+    {"switch",
+     "var i; var d = 0; var s = 0; var n = 0;\n"
+     "i = 0 - 3;\n"
+     "while (i < 12) {\n"
+     "  switch (i) { case 0: d = d + 1; case 1: d = d + 10; case 2: d = d + 100; case 3: d = d + 1000; case 5: d = d + 10000; default: d = d + 100000; }\n"
+     "  switch (i - 1) { case -4: s = s + 1; case 6: s = s + 10; case 300: s = s + 100; case -100: s = s + 1000; case 9: s = s + 10000; }\n"
+     "  switch (0 - i) { case -8: n = n + 1; case -7: n = n + 10; case -6: n = n + 100; case -5: n = n + 1000; case 2: n = n + 10000; }\n"
+     "  i = i + 1;\n"
+     "}\n",
+     {{"d", 1011111}, {"s", 10011}, {"n", 11111}, {"i", 12}}},
+    // A constant index addresses the element directly, a variable one through .addr and one stepped in a loop through a pointer
+    {"array elements",
+     "var a[6]; var i = 0; var s = 0; var k = 2; var f; var l;\n"
+     "a[0] = 7; a[3] = 5;\n"
+     "a[k] = a[3] + a[0];\n"
+     "while (i < 5) { a[i + 1] = a[i + 1] + i; s = s + a[i]; i = i + 1; }\n"
+     "f = a[5]; l = a[1] - a[0];\n",
+     {{"s", 30}, {"f", 4}, {"l", -7}, {"i", 5}, {"a", 7}, {"a+2", 13}, {"a+3", 7}, {"a+5", 4}}},
+};
+
+struct DiagnosticCase {
+    const char *name;
+    const char *source;
+    const char *message;
+    size_t line;
+    size_t column;
+    std::optional<int> stack_size{};
+};
+
+// Invalid programs are reported with the position of the offending token instead of failing some other way
+static const DiagnosticCase s_diagnostics[] = {
+    {"decimal literal out of range", "var x;\nx = 99999999999;\n", "Number out of range", 2, 5},
+    {"hex literal out of range", "var x = 0x1000000;\n", "Number out of range", 1, 9},
+    {"binary literal out of range", "var x = 0b1000000000000000000000000;\n", "Number out of range", 1, 9},
+    {"origin out of range", "var x;\n[org 0x100000]\n", "Origin out of range", 2, 6},
+    {"array size out of range", "var a[0x100001];\n", "Array size out of range", 1, 7},
+    {"division by a non-power of two", "var x;\nx = x / 3;\n", "Only unsigned division by constant powers of two is supported", 2, 7},
+    {"number as a condition", "var x;\nif ((x & 3)) { x = 1; }\n", "Invalid operator ')'", 2, 12},
+    {"stack too small", "var a; var b;\nb = 1;\na = b - (a & b);\n", "Stack size 0 is smaller than the required depth of 1", 3, 1, 0},
+};
+
+static const mima::OptimizationLevel s_levels[] = {
+    mima::OptimizationLevel::O0, mima::OptimizationLevel::O1, mima::OptimizationLevel::O2, mima::OptimizationLevel::Os,
+};
+
+static const char *level_name(mima::OptimizationLevel level) {
+    switch (level) {
+        case mima::OptimizationLevel::O0: return "-O0";
+        case mima::OptimizationLevel::O2: return "-O2";
+        case mima::OptimizationLevel::Os: return "-Os";
+        default: return "-O1";
+    }
+}
+
+static const uint64_t s_step_limit = 1'000'000;
+
+// The word of a variable or "<array>+<index>" element read as a signed number
+static int variable_value(const Program &program, std::string_view variable) {
+    auto plus = variable.find('+');
+    int index = plus == std::string_view::npos ? 0 : std::stoi(std::string(variable.substr(plus + 1)));
+    int word = program.memory[program.labels.at(std::string(variable.substr(0, plus))) + index];
+    return word & 0x800000 ? word - 0x1000000 : word;
+}
+
+// Assembles and runs the program, then compares its variables with the expected values
+static bool check_assembly(const std::string &configuration, const ProgramCase &program_case, const std::string &text) {
+    try {
+        std::istringstream assembly(text);
+        Program program = assemble(assembly);
+        run(program, s_step_limit);
+
+        bool passed = true;
+        for (const auto &expectation : program_case.expected) {
+            int value = variable_value(program, expectation.variable);
+            if (value != expectation.value) {
+                std::cerr << configuration << ": " << expectation.variable << " is " << value << " instead of "
+                          << expectation.value << std::endl;
+                passed = false;
+            }
+        }
+        return passed;
+    } catch (const std::exception &error) {
+        std::cerr << configuration << ": " << error.what() << std::endl;
+        return false;
+    }
+}
+
+static bool check_program(const ProgramCase &program_case, const mima::Options &options) {
+    std::ostringstream configuration;
+    configuration << program_case.name << " (" << level_name(options.optimization)
+                  << (options.format == mima::OutputFormat::Streamed ? ", streamed" : "") << ")";
+
+    auto result = mima::compile(program_case.source, options);
+    if (!result.success) {
+        std::cerr << configuration.str() << ": " << result.diagnostics.front().message << std::endl;
+        return false;
+    }
+
+    return check_assembly(configuration.str(), program_case, result.assembly);
+}
+
+static std::string read_file(const std::filesystem::path &path) {
+    std::ifstream stream(path);
+    std::ostringstream content;
+    content << stream.rdbuf();
+    return content.str();
+}
+
+// A single input given to the compiler with --pipeline runs on the pipeline's threads: nothing is dumped to stdout
+// and lexing and parsing are not timed on their own, as they overlap with code generation
+static bool check_command_line(const std::string &compiler) {
+    const ProgramCase &program_case = s_programs[0];
+    std::string configuration = std::string(program_case.name) + " (--pipeline)";
+
+    auto directory = std::filesystem::temp_directory_path() / ("mima-tests-" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory);
+
+    std::ofstream(directory / "input.mima") << program_case.source;
+
+    std::string command = "\"" + compiler + "\" --pipeline --pass-stats \"" + (directory / "input.mima").string() + "\" \""
+                          + (directory / "output.asm").string() + "\" > \"" + (directory / "stdout").string() + "\" 2> \""
+                          + (directory / "stderr").string() + "\"";
+    int status = std::system(command.c_str());
+
+    std::string output = read_file(directory / "output.asm");
+    std::string dump = read_file(directory / "stdout");
+    std::string statistics = read_file(directory / "stderr");
+    std::filesystem::remove_all(directory);
+
+    if (status != 0) {
+        std::cerr << configuration << ": exited with " << status << std::endl << statistics;
+        return false;
+    }
+
+    if (!dump.empty()) {
+        std::cerr << configuration << ": wrote " << dump.size() << " bytes to stdout" << std::endl;
+        return false;
+    }
+
+    if (statistics.find("lex ") != std::string::npos) {
+        std::cerr << configuration << ": compiled sequentially" << std::endl << statistics;
+        return false;
+    }
+
+    return check_assembly(configuration, program_case, output);
+}
+
+static bool check_diagnostic(const DiagnosticCase &diagnostic_case, mima::Options options) {
+    options.optimization = mima::OptimizationLevel::O0;
+    options.stack_size = diagnostic_case.stack_size;
+
+    auto result = mima::compile(diagnostic_case.source, options);
+
+    if (result.success || result.diagnostics.empty()) {
+        std::cerr << diagnostic_case.name << ": compiled without a diagnostic" << std::endl;
+        return false;
+    }
+
+    const auto &diagnostic = result.diagnostics.front();
+    if (diagnostic.message != diagnostic_case.message || diagnostic.line != diagnostic_case.line
+        || diagnostic.column != diagnostic_case.column) {
+        std::cerr << diagnostic_case.name << ": " << diagnostic.line << ":" << diagnostic.column << ": "
+                  << diagnostic.message << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Takes the path of MIMA_Compiler to test the command line as well
+int main(int argc, char *argv[]) {
+    int failures = 0;
+
+    for (const auto &program_case : s_programs) {
+        for (auto level : s_levels) {
+            for (auto format : {mima::OutputFormat::Aligned, mima::OutputFormat::Streamed}) {
+                mima::Options options;
+                options.optimization = level;
+                options.format = format;
+                failures += !check_program(program_case, options);
+            }
+        }
+    }
+
+    for (const auto &diagnostic_case : s_diagnostics) {
+        mima::Options pipelined;
+        pipelined.format = mima::OutputFormat::Streamed;
+        pipelined.pipelined = true;
+
+        failures += !check_diagnostic(diagnostic_case, {});
+        failures += !check_diagnostic(diagnostic_case, pipelined);
+    }
+
+    if (argc > 1) {
+        failures += !check_command_line(argv[1]);
+    }
+
+    std::cout << failures << " failed" << std::endl;
+    return failures ? 1 : 0;
+}
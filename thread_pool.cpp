@@ -0,0 +1,68 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+};
+
+ThreadPool::ThreadPool(size_t thread_count)
+    : m_thread_count(std::max(thread_count, (size_t)1))
+{ }
+
+void ThreadPool::run(std::vector<std::function<void()>> tasks) const {
+    size_t worker_count = std::min(m_thread_count, tasks.size());
+
+    if (worker_count == 0) {
+        return;
+    }
+
+    std::vector<WorkerQueue> queues(worker_count);
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+        queues[i % worker_count].tasks.push_back(std::move(tasks[i]));
+    }
+
+    // No tasks are added while running, so a worker is done once every queue is empty
+    auto take = [&](size_t worker, std::function<void()> &task) {
+        {
+            std::lock_guard lock(queues[worker].mutex);
+
+            if (!queues[worker].tasks.empty()) {
+                task = std::move(queues[worker].tasks.front());
+                queues[worker].tasks.pop_front();
+                return true;
+            }
+        }
+
+        for (size_t offset = 1; offset < worker_count; offset++) {
+            WorkerQueue &victim = queues[(worker + offset) % worker_count];
+            std::lock_guard lock(victim.mutex);
+
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    std::vector<std::jthread> workers;
+    workers.reserve(worker_count);
+
+    for (size_t worker = 0; worker < worker_count; worker++) {
+        workers.emplace_back([&, worker] {
+            std::function<void()> task;
+
+            while (take(worker, task)) {
+                task();
+            }
+        });
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef MIMA_COMPILER_THREAD_POOL_H
+#define MIMA_COMPILER_THREAD_POOL_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Runs independent tasks on a fixed number of threads. Every worker takes tasks from the front of its own
+// queue and steals from the back of the other queues once it runs dry. Tasks must not throw.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+
+    void run(std::vector<std::function<void()>> tasks) const;
+
+private:
+    size_t m_thread_count;
+};
+
+#endif //MIMA_COMPILER_THREAD_POOL_H